@@ -0,0 +1,60 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "../src/generation/tensor_field.h"
+
+
+// a major eigenvector from (a, b): Tensor::half_angle against the
+// hypot, atan2, cos and sin it replaced
+static constexpr int kTensors = 1 << 20;
+static constexpr int kRounds = 20;
+
+
+template<typename F>
+static double time_ns(const std::vector<RVector2>& ab, F eigenvector) {
+    real sink = 0;
+    double best = 1e30;
+
+    for (int round=0; round<kRounds; ++round) {
+        auto t0 = std::chrono::steady_clock::now();
+
+        for (const RVector2& t : ab) {
+            RVector2 e = eigenvector(t.x, t.y);
+            sink += e.x + e.y;
+        }
+
+        auto t1 = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(t1 - t0).count());
+    }
+
+    // keeps the loops from being optimised away
+    if (sink == real(0.5)) std::printf(" ");
+
+    return best/ab.size();
+}
+
+
+int main() {
+    std::mt19937_64 rng(5);
+
+    std::vector<RVector2> ab(kTensors);
+    for (RVector2& t : ab) {
+        t = {static_cast<real>((rng() >> 11)*0x1p-52 - 1), static_cast<real>((rng() >> 11)*0x1p-52 - 1)};
+    }
+
+    double fast = time_ns(ab, [](real a, real b) {
+        return Tensor::from_a_b(a, b).get_major_eigenvector();
+    });
+
+    double trig = time_ns(ab, [](real a, real b) {
+        real r = std::hypot(a, b);
+        real theta = std::atan2(b/r, a/r)/2;
+        return RVector2{std::cos(theta), std::sin(theta)};
+    });
+
+    std::printf("half_angle: %.1f ns per eigenvector, trig %.1f ns (best of %d rounds of %d)\n",
+        fast, trig, kRounds, kTensors);
+}
@@ -0,0 +1,82 @@
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+
+#include "../src/generation/generator.h"
+
+
+// steps and field samples per streamline of each integrator, one thread,
+// with main.cpp's parameters on a 1920x1080 viewport
+static constexpr size_t kRoadTypes = 3;
+static constexpr int kRounds = 5;
+
+
+struct Scene {
+    const char* name;
+    std::function<void(TensorField&)> build;
+};
+
+
+static void run(const Scene& scene, Integrator integrator, const char* name) {
+    GeneratorParameters params[kRoadTypes] = {
+        GeneratorParameters(1900, 400.0, 200.0, 10.0, 1.0, 500.0, 0.1, 0.5, 10.0),
+        GeneratorParameters(3020, 100.0,  30.0, 8.0, 1.0, 200.0, 0.1, 0.5, 10.0),
+        GeneratorParameters(1970,  20.0,  15.0, 5.0, 1.0,  40.0, 0.1, 0.5, 10.0)
+    };
+
+    TensorField field;
+    scene.build(field);
+
+    RoadGenerator gen(&field, kRoadTypes, params, Box<real>({0, 0}, {1920, 1080}));
+    gen.set_integrator(integrator);
+    gen.set_count_trace(true);
+
+    double best = 1e30;
+
+    for (int round=0; round<kRounds; ++round) {
+        auto t0 = std::chrono::steady_clock::now();
+        gen.generate();
+        auto t1 = std::chrono::steady_clock::now();
+
+        best = std::min(best, std::chrono::duration<double, std::milli>(t1 - t0).count());
+    }
+
+    size_t lines = 0;
+    for (size_t road=0; road<kRoadTypes; ++road) {
+        lines += gen.road_count(road, Eigenfield::major());
+        lines += gen.road_count(road, Eigenfield::minor());
+    }
+
+    RoadGenerator::TraceCounts counts = gen.trace_counts();
+
+    std::printf("%-6s %-13s %6zu %10.1f %12.1f %9llu %8llu %8.1f\n",
+        scene.name, name, lines,
+        double(counts.steps)/lines, double(counts.samples)/lines,
+        (unsigned long long)counts.samples, (unsigned long long)counts.rejected, best);
+}
+
+
+int main() {
+    // the generator logs its seeds to cout
+    std::cout.setstate(std::ios::failbit);
+
+    Scene scenes[] = {
+        {"mixed", [](TensorField& f) {
+            f.add_basis(Grid(0.3, {0, 0}, 0, 0));
+            f.add_basis(Radial({900, 500}, 400, 1));
+            f.add_basis(Grid(1.0, {300, 800}, 300, 2));
+        }},
+        {"grid", [](TensorField& f) {
+            f.add_basis(Grid(0, {0, 0}, 0, 0));
+        }}
+    };
+
+    std::printf("%-6s %-13s %6s %10s %12s %9s %8s %8s\n",
+        "scene", "integrator", "lines", "steps/line", "samples/line", "samples", "rejected", "ms");
+
+    for (const Scene& scene : scenes) {
+        run(scene, FixedRK4, "FixedRK4");
+        run(scene, DormandPrince, "DormandPrince");
+    }
+}
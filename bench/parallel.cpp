@@ -0,0 +1,77 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "../src/generation/generator.h"
+
+
+// speculative tracing against the serial loop over thread counts, with
+// main.cpp's parameters on a 1920x1080 viewport. traced counts every
+// streamline traced, those traced again after a commit included; the
+// ones not committed were wasted work.
+static constexpr size_t kRoadTypes = 3;
+static constexpr int kRounds = 3;
+
+
+int main() {
+    // the generator logs its seeds to cout
+    std::cout.setstate(std::ios::failbit);
+
+    GeneratorParameters params[kRoadTypes] = {
+        GeneratorParameters(1900, 400.0, 200.0, 10.0, 1.0, 500.0, 0.1, 0.5, 10.0),
+        GeneratorParameters(3020, 100.0,  30.0, 8.0, 1.0, 200.0, 0.1, 0.5, 10.0),
+        GeneratorParameters(1970,  20.0,  15.0, 5.0, 1.0,  40.0, 0.1, 0.5, 10.0)
+    };
+
+    TensorField field;
+    field.add_basis(Grid(0.3, {0, 0}, 0, 0));
+    field.add_basis(Radial({900, 500}, 400, 1));
+    field.add_basis(Grid(1.0, {300, 800}, 300, 2));
+
+    int hardware = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+    std::vector<int> thread_counts = {1, 2, 4, 8};
+    for (int t=16; t<=hardware; t*=2) thread_counts.push_back(t);
+    if (hardware > thread_counts.back()) thread_counts.push_back(hardware);
+
+    std::printf("%d hardware threads\n", hardware);
+    std::printf("%-8s %7s %7s %9s %7s %8s %8s\n",
+        "threads", "roads", "traced", "committed", "wasted", "ms", "speedup");
+
+    double serial_ms = 0;
+
+    for (int threads : thread_counts) {
+        RoadGenerator gen(&field, kRoadTypes, params, Box<real>({0, 0}, {1920, 1080}));
+        gen.set_trace_threads(threads);
+        gen.set_count_trace(true);
+
+        double best = 1e30;
+
+        for (int round=0; round<kRounds; ++round) {
+            auto t0 = std::chrono::steady_clock::now();
+            gen.generate();
+            auto t1 = std::chrono::steady_clock::now();
+
+            best = std::min(best, std::chrono::duration<double, std::milli>(t1 - t0).count());
+        }
+
+        size_t roads = 0;
+        for (size_t road=0; road<kRoadTypes; ++road) {
+            roads += gen.road_count(road, Eigenfield::major());
+            roads += gen.road_count(road, Eigenfield::minor());
+        }
+
+        RoadGenerator::TraceCounts counts = gen.trace_counts();
+        if (threads == 1) serial_ms = best;
+
+        // one thread runs the serial loop, more trace speculatively
+        std::printf("%-8d %7zu %7llu %9llu %6.1f%% %8.1f %7.2fx\n",
+            threads, roads,
+            (unsigned long long)counts.traced, (unsigned long long)counts.committed,
+            100.0*(counts.traced - counts.committed)/std::max<std::uint64_t>(counts.traced, 1),
+            best, serial_ms/best);
+    }
+}
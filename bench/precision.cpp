@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "../src/generation/generator.h"
+
+
+// the roads of a float build against those of a double build, with main.cpp's
+// parameters on a 1920x1080 viewport. each build dumps its roads with
+//     precision dump <file>
+// and either build compares two dumps with
+//     precision compare <double-file> <float-file>
+static constexpr size_t kRoadTypes = 3;
+
+
+struct Scene {
+    const char* name;
+    std::function<void(TensorField&)> build;
+};
+
+
+static const Scene kScenes[] = {
+    // App's default field
+    {"grid", [](TensorField& f) {
+        f.add_basis(Grid(0, {0, 0}, 0, 0));
+    }},
+    {"mixed", [](TensorField& f) {
+        f.add_basis(Grid(0.3, {0, 0}, 0, 0));
+        f.add_basis(Radial({900, 500}, 400, 1));
+        f.add_basis(Grid(1.0, {300, 800}, 300, 2));
+    }}
+};
+
+
+// the exact nodes, rather than the float copies handed to raylib
+struct Generator : RoadGenerator {
+    using RoadGenerator::RoadGenerator;
+    using RoadStorage::get_pos;
+    using RoadStorage::get_road;
+};
+
+
+struct DumpRoad {
+    size_t road_type;
+    std::vector<DVector2> points;
+};
+
+
+struct DumpScene {
+    std::string name;
+    std::vector<DumpRoad> roads;
+};
+
+
+static int dump(const char* path) {
+    FILE* out = std::fopen(path, "w");
+    if (!out) {
+        std::perror(path);
+        return 1;
+    }
+
+    // the generator logs its seeds to cout
+    std::cout.setstate(std::ios::failbit);
+
+    for (const Scene& scene : kScenes) {
+        GeneratorParameters params[kRoadTypes] = {
+            GeneratorParameters(1900, 400.0, 200.0, 10.0, 1.0, 500.0, 0.1, 0.5, 10.0),
+            GeneratorParameters(3020, 100.0,  30.0, 8.0, 1.0, 200.0, 0.1, 0.5, 10.0),
+            GeneratorParameters(1970,  20.0,  15.0, 5.0, 1.0,  40.0, 0.1, 0.5, 10.0)
+        };
+
+        TensorField field;
+        scene.build(field);
+
+        Generator gen(&field, kRoadTypes, params, Box<real>({0, 0}, {1920, 1080}));
+        gen.generate();
+
+        std::fprintf(out, "scene %s\n", scene.name);
+
+        Eigenfield efs[2] = {Eigenfield::major(), Eigenfield::minor()};
+
+        for (size_t road_type=0; road_type<kRoadTypes; ++road_type) {
+            for (Eigenfield ef : efs) {
+                RoadHandle hand{0, road_type, ef};
+
+                std::uint32_t count = gen.road_count(road_type, ef);
+                for (std::uint32_t idx=0; idx<count; ++idx) {
+                    hand.idx = idx;
+
+                    const Road& road = gen.get_road(hand);
+                    std::fprintf(out, "road %zu %u\n", road_type, road.end - road.begin);
+
+                    for (std::uint32_t i=road.begin; i<road.end; ++i) {
+                        const RVector2& p = gen.get_pos(NodeHandle{i, hand});
+                        std::fprintf(out, "%.17g %.17g\n", (double)p.x, (double)p.y);
+                    }
+                }
+            }
+        }
+    }
+
+    std::fclose(out);
+    return 0;
+}
+
+
+static bool load(const char* path, std::vector<DumpScene>& scenes) {
+    FILE* in = std::fopen(path, "r");
+    if (!in) {
+        std::perror(path);
+        return false;
+    }
+
+    char word[64];
+    while (std::fscanf(in, "%63s", word) == 1) {
+        if (std::strcmp(word, "scene") == 0) {
+            if (std::fscanf(in, "%63s", word) != 1) break;
+            scenes.push_back({word, {}});
+        }
+        else if (std::strcmp(word, "road") == 0 && !scenes.empty()) {
+            DumpRoad road;
+            unsigned n = 0;
+            if (std::fscanf(in, "%zu %u", &road.road_type, &n) != 2) break;
+
+            road.points.resize(n);
+            for (DVector2& p : road.points) {
+                if (std::fscanf(in, "%lf %lf", &p.x, &p.y) != 2) break;
+            }
+            scenes.back().roads.push_back(std::move(road));
+        }
+        else break;
+    }
+
+    bool ok = std::feof(in);
+    std::fclose(in);
+
+    if (!ok) std::fprintf(stderr, "%s: malformed dump\n", path);
+    return ok;
+}
+
+
+static size_t node_count(const DumpScene& scene) {
+    size_t n = 0;
+    for (const DumpRoad& road : scene.roads) n += road.points.size();
+    return n;
+}
+
+
+static double distance_to_segment(const DVector2& p, const DVector2& x0, const DVector2& x1) {
+    DVector2 d = x1 - x0;
+    DVector2 r = p - x0;
+
+    double l2 = dot_product(d, d);
+    double t = l2 == 0 ? 0 : std::clamp(dot_product(r, d)/l2, 0.0, 1.0);
+
+    DVector2 closest = r - d*t;
+    return std::hypot(closest.x, closest.y);
+}
+
+
+// distance from each node of a to the nearest road of b of the same type
+static std::vector<double> node_distances(const DumpScene& a, const DumpScene& b) {
+    std::vector<double> out;
+
+    for (const DumpRoad& ra : a.roads) {
+        for (const DVector2& p : ra.points) {
+            double best = std::numeric_limits<double>::infinity();
+
+            for (const DumpRoad& rb : b.roads) {
+                if (rb.road_type != ra.road_type) continue;
+
+                if (rb.points.size() == 1)
+                    best = std::min(best, distance_to_segment(p, rb.points[0], rb.points[0]));
+
+                for (size_t i=1; i<rb.points.size(); ++i)
+                    best = std::min(best, distance_to_segment(p, rb.points[i-1], rb.points[i]));
+            }
+
+            out.push_back(best);
+        }
+    }
+
+    return out;
+}
+
+
+static int compare(const char* double_path, const char* float_path) {
+    std::vector<DumpScene> ds, fs;
+    if (!load(double_path, ds) || !load(float_path, fs)) return 1;
+
+    std::printf("%-6s %13s %13s %10s %10s %10s\n",
+        "scene", "roads", "nodes", "mean px", "p99 px", "max px");
+
+    for (const DumpScene& d : ds) {
+        auto f = std::find_if(fs.begin(), fs.end(),
+            [&](const DumpScene& s) { return s.name == d.name; });
+        if (f == fs.end()) continue;
+
+        // both ways, so a road one build lacks shows up as well
+        std::vector<double> dist = node_distances(d, *f);
+        std::vector<double> back = node_distances(*f, d);
+        dist.insert(dist.end(), back.begin(), back.end());
+
+        std::sort(dist.begin(), dist.end());
+
+        double mean = 0;
+        for (double x : dist) mean += x;
+        mean = dist.empty() ? 0 : mean/dist.size();
+
+        double p99 = dist.empty() ? 0 : dist[dist.size()*99/100];
+        double max = dist.empty() ? 0 : dist.back();
+
+        std::printf("%-6s %6zu/%-6zu %6zu/%-6zu %10.2g %10.2g %10.2g\n",
+            d.name.c_str(), d.roads.size(), f->roads.size(),
+            node_count(d), node_count(*f), mean, p99, max);
+    }
+
+    return 0;
+}
+
+
+int main(int argc, char** argv) {
+    if (argc == 3 && std::strcmp(argv[1], "dump") == 0)
+        return dump(argv[2]);
+
+    if (argc == 4 && std::strcmp(argv[1], "compare") == 0)
+        return compare(argv[2], argv[3]);
+
+    std::fprintf(stderr, "usage: %s dump <file>\n"
+                         "       %s compare <double-file> <float-file>\n", argv[0], argv[0]);
+    return 1;
+}
@@ -0,0 +1,94 @@
+#include "candidate_seeds.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+// heap order, the top is the entry no other comes after
+bool CandidateSeeds::later(const Entry& l, const Entry& r) {
+    if (l.key != r.key) return l.key > r.key;
+    return l.order > r.order;
+}
+
+
+std::uint64_t CandidateSeeds::cell_key(int cx, int cy) const {
+    return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(cx)) << 32)
+        | static_cast<std::uint32_t>(cy);
+}
+
+
+std::uint64_t CandidateSeeds::cell_of(const RVector2& pos) const {
+    return cell_key(
+        static_cast<int>(std::floor(pos.x/min_sep_)),
+        static_cast<int>(std::floor(pos.y/min_sep_))
+    );
+}
+
+
+void CandidateSeeds::reset(real min_sep) {
+    assert(min_sep > 0.0);
+
+    min_sep_ = min_sep;
+    added_ = 0;
+    heap_.clear();
+    cells_.clear();
+}
+
+
+bool CandidateSeeds::empty() const {
+    return heap_.empty();
+}
+
+
+size_t CandidateSeeds::size() const {
+    return heap_.size();
+}
+
+
+bool CandidateSeeds::accepts(const RVector2& pos) const {
+    int cx = static_cast<int>(std::floor(pos.x/min_sep_));
+    int cy = static_cast<int>(std::floor(pos.y/min_sep_));
+    real min_sep2 = min_sep_*min_sep_;
+
+    for (int dx=-1; dx<=1; ++dx) {
+        for (int dy=-1; dy<=1; ++dy) {
+            auto it = cells_.find(cell_key(cx+dx, cy+dy));
+            if (it == cells_.end()) continue;
+
+            for (const RVector2& p : it->second) {
+                RVector2 diff = p - pos;
+                if (dot_product(diff, diff) < min_sep2) return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+bool CandidateSeeds::push(const RVector2& pos, real key) {
+    if (!accepts(pos)) return false;
+
+    cells_[cell_of(pos)].push_back(pos);
+
+    heap_.push_back({key, added_++, pos});
+    std::push_heap(heap_.begin(), heap_.end(), later);
+
+    return true;
+}
+
+
+RVector2 CandidateSeeds::pop() {
+    assert(!empty());
+
+    std::pop_heap(heap_.begin(), heap_.end(), later);
+    RVector2 pos = heap_.back().pos;
+    heap_.pop_back();
+
+    auto it = cells_.find(cell_of(pos));
+    std::vector<RVector2>& cell = it->second;
+    cell.erase(std::find(cell.begin(), cell.end(), pos));
+    if (cell.empty()) cells_.erase(it);
+
+    return pos;
+}
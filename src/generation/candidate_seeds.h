@@ -0,0 +1,55 @@
+#ifndef CANDIDATE_SEEDS_H
+#define CANDIDATE_SEEDS_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "../types.h"
+
+
+enum SeedOrder {
+    FirstIn,    // in the order they were added
+    OpenSpace,  // furthest from the nearest road first
+    CentreOut   // nearest the viewport centre first
+};
+
+
+// candidate seeds left by road ends, popped lowest key first and in the
+// order they were added among equal keys. a spatial hash of cells of
+// min_sep drops a candidate closer than min_sep to one already queued,
+// only one of the two could seed a road.
+class CandidateSeeds {
+private:
+    struct Entry {
+        real key;
+        std::uint64_t order;
+        RVector2 pos;
+    };
+
+    real min_sep_ = 1;
+    std::uint64_t added_ = 0;
+    std::vector<Entry> heap_;
+    std::unordered_map<std::uint64_t, std::vector<RVector2>> cells_;
+
+    static bool later(const Entry& l, const Entry& r);
+    std::uint64_t cell_key(int cx, int cy) const;
+    std::uint64_t cell_of(const RVector2& pos) const;
+
+public:
+    // empties the queue, candidates closer than min_sep are dropped
+    void reset(real min_sep);
+
+    bool empty() const;
+    size_t size() const;
+
+    // false if pos would be dropped for a queued candidate nearby, one
+    // probe of the hash, so a key costly to compute is only needed after
+    bool accepts(const RVector2& pos) const;
+
+    // false if pos was dropped for a queued candidate nearby
+    bool push(const RVector2& pos, real key);
+    RVector2 pop();
+};
+
+#endif
@@ -0,0 +1,529 @@
+#include "chunk_world.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <random>
+
+
+static constexpr char kMagic[8] = {'C', 'G', 'C', 'H', 'N', 'K', '0', '1'};
+
+
+static bool overlaps(const Box<real>& a, const Box<real>& b) {
+    return a.min.x < b.max.x && b.min.x < a.max.x
+        && a.min.y < b.max.y && b.min.y < a.max.y;
+}
+
+
+// neighbouring chunks get unrelated random streams
+static std::uint64_t chunk_seed(int cx, int cy) {
+    return CounterRng::key({
+        (static_cast<std::uint64_t>(static_cast<std::uint32_t>(cx)) << 32)
+            | static_cast<std::uint32_t>(cy)
+    });
+}
+
+
+size_t ChunkWorld::ChunkKeyHash::operator()(const ChunkKey& k) const {
+    size_t h = std::hash<int>()(k.cx);
+    h = h*31 + std::hash<int>()(k.cy);
+    return h;
+}
+
+
+ChunkWorld::ChunkWorld(const TensorField* field, const RoadGenerator* proto,
+    real chunk_size, std::string cache_dir, int thread_count) :
+    field_(field),
+    proto_(proto),
+    chunk_size_(chunk_size),
+    cache_dir_(std::move(cache_dir)),
+    session_(std::random_device()())
+{
+    assert(chunk_size_ > 0);
+
+    if (!cache_dir_.empty()) {
+        std::error_code ec;
+        made_cache_dir_ = std::filesystem::create_directories(cache_dir_, ec);
+        if (ec) cache_dir_.clear(); // evict without writing
+    }
+
+    if (thread_count <= 0) {
+        thread_count = std::max(1,
+            static_cast<int>(std::thread::hardware_concurrency()) - 1);
+    }
+
+    for (int i=0; i<thread_count; ++i) {
+        workers_.emplace_back(&ChunkWorld::worker_loop, this);
+    }
+}
+
+
+ChunkWorld::~ChunkWorld() {
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    jobs_cv_.notify_all();
+
+    for (std::thread& w : workers_) w.join();
+
+    // other worlds may share the directory, so only this one's files go
+    std::error_code ec;
+    for (const std::string& path : written_) std::filesystem::remove(path, ec);
+
+    if (made_cache_dir_) std::filesystem::remove(cache_dir_, ec); // if empty
+}
+
+
+real ChunkWorld::chunk_size() const {
+    return chunk_size_;
+}
+
+
+ChunkWorld::ChunkKey ChunkWorld::key_at(const RVector2& pos) const {
+    return {
+        static_cast<int>(std::floor(pos.x/chunk_size_)),
+        static_cast<int>(std::floor(pos.y/chunk_size_))
+    };
+}
+
+
+RVector2 ChunkWorld::origin(const ChunkKey& key) const {
+    return {key.cx*chunk_size_, key.cy*chunk_size_};
+}
+
+
+Box<real> ChunkWorld::chunk_bbox(const ChunkKey& key) const {
+    RVector2 min = origin(key);
+    return Box(min, min + RVector2{chunk_size_, chunk_size_});
+}
+
+
+std::string ChunkWorld::cache_path(const ChunkKey& key, std::uint64_t session) const {
+    return cache_dir_ + "/chunk_" + std::to_string(session)
+        + "_" + std::to_string(key.cx) + "_" + std::to_string(key.cy) + ".bin";
+}
+
+
+void ChunkWorld::sync_snapshot() {
+    std::uint64_t version = field_->version();
+    if (snapshot_ != nullptr && version == snapshot_version_) return;
+
+    if (snapshot_ != nullptr) {
+        auto dirty = field_->dirty_since(snapshot_version_);
+
+        std::lock_guard lock(mutex_);
+        for (auto& [key, chunk] : chunks_) {
+            bool touched = !dirty.has_value();
+
+            // a chunk is traced over its halo too, which is narrower than
+            // a chunk
+            if (!touched) {
+                RVector2 margin = {chunk_size_, chunk_size_};
+                Box<real> bbox = chunk_bbox(key);
+                bbox = Box(bbox.min - margin, bbox.max + margin);
+
+                touched = std::any_of(dirty->begin(), dirty->end(),
+                    [&bbox](const Box<real>& r) { return overlaps(r, bbox); });
+            }
+
+            // keep the stale roads on screen until the new ones land
+            if (touched) chunk.dirty_version = version;
+        }
+    }
+
+    snapshot_ = std::make_shared<const TensorField>(*field_);
+    snapshot_version_ = version;
+}
+
+
+void ChunkWorld::schedule(const Box<real>& view) {
+    ChunkKey lo = key_at(view.min);
+    ChunkKey hi = key_at(view.max);
+
+    // a ring around the view so panning finds chunks ready, unless the
+    // view alone already asks for as many chunks as are kept
+    size_t count = static_cast<size_t>(hi.cx-lo.cx+1)*(hi.cy-lo.cy+1);
+    int ring = count < kMaxChunks/2 ? 1 : 0;
+
+    std::lock_guard lock(mutex_);
+
+    // requests from earlier frames are superseded by this one
+    jobs_.clear();
+
+    for (int r=ring; r>=0; --r) {
+        for (int cx=lo.cx-r; cx<=hi.cx+r; ++cx) {
+            for (int cy=lo.cy-r; cy<=hi.cy+r; ++cy) {
+                bool on_ring = cx < lo.cx-r+1 || cx > hi.cx+r-1
+                    || cy < lo.cy-r+1 || cy > hi.cy+r-1;
+                if (r > 0 && !on_ring) continue;
+
+                ChunkKey key = {cx, cy};
+                Chunk& chunk = chunks_[key];
+                chunk.last_used = frame_;
+
+                // evicted but not written yet, take it back
+                if (chunk.data == nullptr) {
+                    auto it = std::find_if(stores_.begin(), stores_.end(),
+                        [&key](const StoreJob& s) { return s.key == key; });
+
+                    if (it != stores_.end() && it->session == session_) {
+                        chunk.data = it->data;
+                        chunk.data_version = it->version;
+                        stores_.erase(it);
+                    }
+                }
+
+                bool fresh = chunk.data != nullptr
+                    && chunk.data_version >= chunk.dirty_version;
+
+                if (!fresh && !chunk.in_flight) {
+                    jobs_.push_back({key, snapshot_, snapshot_version_, session_});
+                }
+            }
+        }
+    }
+
+    jobs_cv_.notify_all();
+}
+
+
+void ChunkWorld::evict() {
+    std::lock_guard lock(mutex_);
+    if (chunks_.size() <= kMaxChunks) return;
+
+    std::erase_if(chunks_, [this](const auto& entry) {
+        const Chunk& chunk = entry.second;
+        bool evict = !chunk.in_flight && chunk.last_used + kKeepFrames < frame_;
+
+        bool keep = chunk.data != nullptr && !cache_dir_.empty()
+            && chunk.data_version >= chunk.dirty_version;
+
+        if (evict && keep) {
+            stores_.push_back({entry.first, chunk.data, chunk.data_version, session_});
+        }
+
+        return evict;
+    });
+
+    std::erase_if(seams_, [this](const auto& entry) {
+        return !chunks_.contains(entry.first);
+    });
+
+    if (!stores_.empty()) jobs_cv_.notify_all();
+}
+
+
+std::shared_ptr<const std::vector<ChunkWorld::ChunkRoad>>
+ChunkWorld::stitch(const ChunkKey& a, const ChunkData& a_data,
+    const ChunkKey& b, const ChunkData& b_data) const
+{
+    RVector2 a_origin = origin(a);
+    RVector2 b_origin = origin(b);
+
+    // open roads of both chunks in world space, tile 0 and 1
+    std::vector<RoadGenerator::TilePiece> pieces;
+
+    for (const auto& [data, o, tile] : {
+        std::tuple{&a_data, a_origin, size_t(0)},
+        std::tuple{&b_data, b_origin, size_t(1)}})
+    {
+        for (const ChunkRoad& road : data->roads) {
+            if (!road.open[0] && !road.open[1]) continue;
+
+            std::vector<RVector2> points;
+            points.reserve(road.points.size());
+            for (const Vector2& p : road.points) {
+                points.push_back(o + RVector2(p));
+            }
+
+            pieces.push_back({std::move(points), road.road_type, road.ef,
+                tile, road.open});
+        }
+    }
+
+    RoadGenerator::TileLinks links = proto_->pair_tile_ends(pieces);
+
+    auto out = std::make_shared<std::vector<ChunkRoad>>();
+
+    for (size_t i=0; i<pieces.size(); ++i) {
+        if (pieces[i].tile != 0) continue;
+
+        for (int side=0; side<2; ++side) {
+            if (!links[i][side].has_value()) continue;
+
+            const RoadGenerator::TileEnd& end = links[i][side].value();
+            const RoadGenerator::TilePiece& other = pieces[end.piece];
+
+            RVector2 p = side == 0 ? pieces[i].points.front() : pieces[i].points.back();
+            RVector2 q = end.side == 0 ? other.points.front() : other.points.back();
+
+            out->push_back({pieces[i].road_type, pieces[i].ef, {false, false},
+                {Vector2(p - a_origin), Vector2(q - a_origin)}});
+        }
+    }
+
+    return out;
+}
+
+
+void ChunkWorld::update_visible(const Box<real>& view) {
+    ChunkKey lo = key_at(view.min);
+    ChunkKey hi = key_at(view.max);
+
+    visible_.clear();
+
+    // the seams on the left and bottom edges belong to the chunks below
+    // and to the left of the view
+    std::unordered_map<ChunkKey, std::shared_ptr<const ChunkData>, ChunkKeyHash> ready;
+    {
+        std::lock_guard lock(mutex_);
+
+        for (int cx=lo.cx-1; cx<=hi.cx+1; ++cx) {
+            for (int cy=lo.cy-1; cy<=hi.cy+1; ++cy) {
+                auto it = chunks_.find({cx, cy});
+                if (it == chunks_.end() || it->second.data == nullptr) continue;
+
+                ready[{cx, cy}] = it->second.data;
+            }
+        }
+    }
+
+    for (int cx=lo.cx-1; cx<=hi.cx; ++cx) {
+        for (int cy=lo.cy-1; cy<=hi.cy; ++cy) {
+            ChunkKey key = {cx, cy};
+            auto it = ready.find(key);
+            if (it == ready.end()) continue;
+
+            View v = {origin(key), it->second, {}};
+
+            ChunkKey neighbours[2] = {{cx+1, cy}, {cx, cy+1}};
+
+            for (int dir=0; dir<2; ++dir) {
+                auto nb = ready.find(neighbours[dir]);
+                if (nb == ready.end()) continue;
+
+                Seam& seam = seams_[key][dir];
+
+                if (seam.a != it->second || seam.b != nb->second) {
+                    seam.a = it->second;
+                    seam.b = nb->second;
+                    seam.roads = stitch(key, *seam.a, neighbours[dir], *seam.b);
+                }
+
+                v.seams[dir] = seam.roads;
+            }
+
+            visible_.push_back(std::move(v));
+        }
+    }
+}
+
+
+void ChunkWorld::request(const Box<real>& view) {
+    ++frame_;
+
+    sync_snapshot();
+    schedule(view);
+    evict();
+    update_visible(view);
+}
+
+
+void ChunkWorld::clear() {
+    std::lock_guard lock(mutex_);
+
+    ++session_;
+    jobs_.clear();
+
+    // in flight results of the old session are discarded when they land
+    std::erase_if(chunks_, [](const auto& entry) {
+        return !entry.second.in_flight;
+    });
+
+    for (auto& [key, chunk] : chunks_) chunk.data = nullptr;
+
+    seams_.clear();
+    visible_.clear();
+}
+
+
+const std::vector<ChunkWorld::View>& ChunkWorld::visible() const {
+    return visible_;
+}
+
+
+void ChunkWorld::worker_loop() {
+    std::unique_lock lock(mutex_);
+
+    while (true) {
+        jobs_cv_.wait(lock, [this] {
+            return stop_ || !jobs_.empty() || !stores_.empty();
+        });
+        if (stop_) return;
+
+        // evicted chunks are still in memory until written
+        if (!stores_.empty()) {
+            StoreJob job = std::move(stores_.back());
+            stores_.pop_back();
+
+            lock.unlock();
+            store(job);
+            lock.lock();
+
+            written_.insert(cache_path(job.key, job.session));
+            continue;
+        }
+
+        Job job = std::move(jobs_.back());
+        jobs_.pop_back();
+
+        Chunk& chunk = chunks_[job.key];
+        bool fresh = chunk.data != nullptr
+            && chunk.data_version >= chunk.dirty_version;
+
+        if (chunk.in_flight || fresh) continue;
+        chunk.in_flight = true;
+
+        lock.unlock();
+        std::shared_ptr<const ChunkData> data = load(job);
+        if (data == nullptr) data = generate(job);
+        lock.lock();
+
+        // the chunk cannot be evicted while in flight
+        Chunk& done = chunks_[job.key];
+        done.in_flight = false;
+
+        if (job.session != session_) continue;
+
+        if (done.data == nullptr || job.version >= done.data_version) {
+            done.data = std::move(data);
+            done.data_version = job.version;
+        }
+    }
+}
+
+
+std::shared_ptr<const ChunkWorld::ChunkData>
+ChunkWorld::generate(const Job& job) const {
+    constexpr real inf = std::numeric_limits<real>::infinity();
+
+    Box<real> core = chunk_bbox(job.key);
+
+    // traced in small numbers relative to the chunk, which keep their
+    // precision in float however far the chunk is from the origin
+    std::vector<RoadGenerator::TilePiece> pieces = proto_->generate_tile(
+        job.snapshot.get(), core, Box<real>({-inf, -inf}, {inf, inf}),
+        chunk_seed(job.key.cx, job.key.cy), core.min);
+
+    auto data = std::make_shared<ChunkData>();
+    data->roads.reserve(pieces.size());
+
+    for (const RoadGenerator::TilePiece& piece : pieces) {
+        ChunkRoad road = {piece.road_type, piece.ef, piece.open, {}};
+        road.points.reserve(piece.points.size());
+
+        for (const RVector2& p : piece.points) road.points.push_back(Vector2(p));
+
+        data->roads.push_back(std::move(road));
+    }
+
+    return data;
+}
+
+
+// cache file: magic, session, version, road count, then per road its type,
+// eigenfield, open ends, point count and points
+std::shared_ptr<const ChunkWorld::ChunkData>
+ChunkWorld::load(const Job& job) const {
+    if (cache_dir_.empty()) return nullptr;
+
+    std::ifstream file(cache_path(job.key, job.session), std::ios::binary);
+    if (!file) return nullptr;
+
+    char magic[8];
+    std::uint64_t session, version;
+    std::uint32_t count;
+
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&session), sizeof(session));
+    file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    file.read(reinterpret_cast<char*>(&count), sizeof(count));
+
+    if (!file || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0
+        || session != job.session || version != job.version)
+        return nullptr;
+
+    auto data = std::make_shared<ChunkData>();
+    data->roads.reserve(count);
+
+    for (std::uint32_t i=0; i<count; ++i) {
+        std::uint32_t road_type, n;
+        std::uint8_t ef, open[2];
+
+        file.read(reinterpret_cast<char*>(&road_type), sizeof(road_type));
+        file.read(reinterpret_cast<char*>(&ef), sizeof(ef));
+        file.read(reinterpret_cast<char*>(open), sizeof(open));
+        file.read(reinterpret_cast<char*>(&n), sizeof(n));
+        if (!file) return nullptr;
+
+        ChunkRoad road = {
+            road_type,
+            ef ? Eigenfield::major() : Eigenfield::minor(),
+            {open[0] != 0, open[1] != 0},
+            std::vector<Vector2>(n)
+        };
+
+        file.read(reinterpret_cast<char*>(road.points.data()), n*sizeof(Vector2));
+        data->roads.push_back(std::move(road));
+    }
+
+    if (!file) return nullptr;
+    return data;
+}
+
+
+void ChunkWorld::store(const StoreJob& job) const {
+    std::string path = cache_path(job.key, job.session);
+    std::string tmp = path + ".tmp";
+
+    {
+        std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+        if (!file) return;
+
+        std::uint32_t count = job.data->roads.size();
+
+        file.write(kMagic, sizeof(kMagic));
+        file.write(reinterpret_cast<const char*>(&job.session), sizeof(job.session));
+        file.write(reinterpret_cast<const char*>(&job.version), sizeof(job.version));
+        file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+
+        for (const ChunkRoad& road : job.data->roads) {
+            std::uint32_t road_type = road.road_type;
+            std::uint8_t ef = road.ef == Eigenfield::major();
+            std::uint8_t open[2] = {road.open[0], road.open[1]};
+            std::uint32_t n = road.points.size();
+
+            file.write(reinterpret_cast<const char*>(&road_type), sizeof(road_type));
+            file.write(reinterpret_cast<const char*>(&ef), sizeof(ef));
+            file.write(reinterpret_cast<const char*>(open), sizeof(open));
+            file.write(reinterpret_cast<const char*>(&n), sizeof(n));
+            file.write(reinterpret_cast<const char*>(road.points.data()),
+                n*sizeof(Vector2));
+        }
+
+        if (!file) {
+            file.close();
+            std::remove(tmp.c_str());
+            return;
+        }
+    }
+
+    // a chunk read meanwhile sees the old file or the whole new one
+    std::rename(tmp.c_str(), path.c_str());
+}
@@ -0,0 +1,162 @@
+#ifndef CHUNK_WORLD_H
+#define CHUNK_WORLD_H
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "../types.h"
+#include "generator.h"
+#include "tensor_field.h"
+
+
+// an unbounded road network, generated in square chunks around the view
+// on background threads. a chunk is a tile of RoadGenerator::generate_tile
+// seeded from its coordinates, so it comes out the same whenever it is
+// generated and its seams line up with any neighbour. chunks that have not
+// been seen for a while are dropped, or written to a cache directory and
+// read back when the view returns.
+class ChunkWorld {
+public:
+    struct ChunkRoad {
+        size_t road_type;
+        Eigenfield ef;
+        std::array<bool, 2> open;   // front, back cut at the chunk edge
+        std::vector<Vector2> points; // relative to the chunk origin
+    };
+
+    struct ChunkData {
+        std::vector<ChunkRoad> roads;
+    };
+
+    // a chunk ready to draw, with the connectors across its right and top
+    // seams (relative to the same origin, null until the neighbour is ready)
+    struct View {
+        RVector2 origin;
+        std::shared_ptr<const ChunkData> data;
+        std::array<std::shared_ptr<const std::vector<ChunkRoad>>, 2> seams;
+    };
+
+private:
+    static constexpr size_t kMaxChunks = 256;
+    static constexpr std::uint64_t kKeepFrames = 600;
+
+    struct ChunkKey {
+        int cx;
+        int cy;
+
+        bool operator==(const ChunkKey& other) const = default;
+    };
+
+    struct ChunkKeyHash {
+        size_t operator()(const ChunkKey& k) const;
+    };
+
+    struct Chunk {
+        std::shared_ptr<const ChunkData> data;
+        std::uint64_t data_version = 0;
+        std::uint64_t dirty_version = 0;
+        std::uint64_t last_used = 0; // frame
+        bool in_flight = false;
+    };
+
+    // connectors between a chunk and its right (0) or top (1) neighbour,
+    // remembered with the data they were made from. held, not just pointed
+    // at, so regenerated data can never reuse the address of the old.
+    struct Seam {
+        std::shared_ptr<const ChunkData> a;
+        std::shared_ptr<const ChunkData> b;
+        std::shared_ptr<const std::vector<ChunkRoad>> roads;
+    };
+
+    struct Job {
+        ChunkKey key;
+        std::shared_ptr<const TensorField> snapshot;
+        std::uint64_t version;
+        std::uint64_t session;
+    };
+
+    struct StoreJob {
+        ChunkKey key;
+        std::shared_ptr<const ChunkData> data;
+        std::uint64_t version;
+        std::uint64_t session;
+    };
+
+    const TensorField* field_;
+    const RoadGenerator* proto_; // parameters and obstacles
+    real chunk_size_;
+    std::string cache_dir_;
+    bool made_cache_dir_ = false;
+    std::uint64_t session_; // names cache files, bumped by clear()
+
+    std::shared_ptr<const TensorField> snapshot_;
+    std::uint64_t snapshot_version_ = 0;
+    std::uint64_t frame_ = 0;
+
+    mutable std::mutex mutex_; // guards chunks_, jobs_, stores_, written_, session_, stop_
+    std::condition_variable jobs_cv_;
+    std::unordered_map<ChunkKey, Chunk, ChunkKeyHash> chunks_;
+    std::vector<Job> jobs_; // stack, most urgent last
+    std::vector<StoreJob> stores_; // written before chunks are generated
+    std::unordered_set<std::string> written_; // cache files, of every session
+    bool stop_ = false;
+
+    // main thread only
+    std::unordered_map<ChunkKey, std::array<Seam, 2>, ChunkKeyHash> seams_;
+    std::vector<View> visible_;
+
+    std::vector<std::thread> workers_;
+
+    ChunkKey key_at(const RVector2& pos) const;
+    RVector2 origin(const ChunkKey& key) const;
+    Box<real> chunk_bbox(const ChunkKey& key) const;
+    std::string cache_path(const ChunkKey& key, std::uint64_t session) const;
+
+    void sync_snapshot();
+    void schedule(const Box<real>& view);
+    void evict();
+    void update_visible(const Box<real>& view);
+
+    std::shared_ptr<const std::vector<ChunkRoad>> stitch(
+        const ChunkKey& a, const ChunkData& a_data,
+        const ChunkKey& b, const ChunkData& b_data) const;
+
+    void worker_loop();
+    std::shared_ptr<const ChunkData> generate(const Job& job) const;
+    std::shared_ptr<const ChunkData> load(const Job& job) const;
+    void store(const StoreJob& job) const;
+
+public:
+    // cache_dir may be empty to drop far chunks instead of writing them.
+    // the files written there are removed with the world.
+    ChunkWorld(const TensorField* field, const RoadGenerator* proto,
+        real chunk_size, std::string cache_dir = "", int thread_count = 0);
+    ~ChunkWorld();
+
+    ChunkWorld(const ChunkWorld&) = delete;
+    ChunkWorld& operator=(const ChunkWorld&) = delete;
+
+    real chunk_size() const;
+
+    // main thread, once per frame: picks up field edits, queues the chunks
+    // around view and collects the ready ones that overlap it
+    void request(const Box<real>& view);
+
+    // drops every chunk so the world is generated again, after the
+    // generator's parameters or obstacles were changed
+    void clear();
+
+    // the chunks of the last request that are ready
+    const std::vector<View>& visible() const;
+};
+
+#endif
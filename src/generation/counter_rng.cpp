@@ -0,0 +1,56 @@
+#include "counter_rng.h"
+
+#include <cassert>
+
+
+static constexpr std::uint64_t kGolden = 0x9e3779b97f4a7c15ull;
+
+
+CounterRng::CounterRng(std::uint64_t key) :
+    key_(key)
+{}
+
+
+// the splitmix64 finalizer
+std::uint64_t CounterRng::mix(std::uint64_t z) {
+    z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27))*0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+
+std::uint64_t CounterRng::key(std::initializer_list<std::uint64_t> ids) {
+    std::uint64_t k = 0;
+    for (std::uint64_t id : ids) k = mix(k + kGolden + id);
+    return k;
+}
+
+
+std::uint64_t CounterRng::counter() const {
+    return counter_;
+}
+
+
+void CounterRng::seek(std::uint64_t counter) {
+    counter_ = counter;
+}
+
+
+std::uint64_t CounterRng::next() {
+    return mix(key_ + kGolden*++counter_);
+}
+
+
+// the top 53 bits, every double of the form k/2^53
+double CounterRng::unit() {
+    return static_cast<double>(next() >> 11)*0x1.0p-53;
+}
+
+
+// fixed point multiply of 32 random bits, bias below n/2^32
+std::uint64_t CounterRng::below(std::uint64_t n) {
+    assert(n > 0);
+
+    if (n <= 0xffffffffull) return ((next() >> 32)*n) >> 32;
+    return next() % n;
+}
@@ -0,0 +1,33 @@
+#ifndef COUNTER_RNG_H
+#define COUNTER_RNG_H
+
+#include <cstdint>
+#include <initializer_list>
+
+
+// counter-based random numbers, splitmix64 of key and counter: the n-th
+// draw of a stream only depends on its key and n, never on what other
+// streams drew before, so a stream keyed by what it is for comes out the
+// same in any run, build or thread count.
+class CounterRng {
+private:
+    std::uint64_t key_;
+    std::uint64_t counter_ = 0;
+
+public:
+    explicit CounterRng(std::uint64_t key = 0);
+
+    static std::uint64_t mix(std::uint64_t z);
+
+    // the key of the stream for ids, hashed in turn
+    static std::uint64_t key(std::initializer_list<std::uint64_t> ids);
+
+    std::uint64_t counter() const;
+    void seek(std::uint64_t counter);
+
+    std::uint64_t next();
+    double unit();                       // [0, 1)
+    std::uint64_t below(std::uint64_t n); // [0, n), n > 0
+};
+
+#endif
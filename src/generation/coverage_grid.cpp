@@ -0,0 +1,195 @@
+#include "coverage_grid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+
+void CoverageGrid::reset(const Box<real>& bounds, real cell_size) {
+    assert(cell_size > 0.0);
+
+    bounds_ = bounds;
+    cell_size_ = cell_size;
+    cols_ = std::max(0, static_cast<int>(std::ceil(bounds.width()/cell_size)));
+    rows_ = std::max(0, static_cast<int>(std::ceil(bounds.height()/cell_size)));
+
+    size_t n = static_cast<size_t>(cols_)*rows_;
+
+    parts_.clear();
+    parts_.reserve(n);
+    for (size_t cell=0; cell<n; ++cell) parts_.push_back({cell_box(cell)});
+
+    open_.resize(n);
+    std::iota(open_.begin(), open_.end(), 0);
+    slot_.resize(n);
+    std::iota(slot_.begin(), slot_.end(), 0);
+    closed_.assign(n, 0);
+    last_ = kNone;
+}
+
+
+size_t CoverageGrid::cell_count() const {
+    return slot_.size();
+}
+
+
+size_t CoverageGrid::open_count() const {
+    return open_.size();
+}
+
+
+bool CoverageGrid::saturated() const {
+    return open_.empty();
+}
+
+
+// clipped to bounds at the last row and column
+Box<real> CoverageGrid::cell_box(size_t cell) const {
+    int i = static_cast<int>(cell % cols_);
+    int j = static_cast<int>(cell / cols_);
+
+    RVector2 min = bounds_.min + RVector2{i*cell_size_, j*cell_size_};
+    return Box<real>(min, min + RVector2{cell_size_, cell_size_}) & bounds_;
+}
+
+
+void CoverageGrid::open(std::uint32_t part) {
+    slot_[part] = static_cast<std::uint32_t>(open_.size());
+    open_.push_back(part);
+}
+
+
+// drops a part and its quarters from the open ones
+void CoverageGrid::retire(std::uint32_t part) {
+    std::uint32_t children = parts_[part].children;
+    if (children != kNone) {
+        for (std::uint32_t c=children; c<children+4; ++c) retire(c);
+    }
+
+    std::uint32_t s = slot_[part];
+    if (s == kNone) return;
+
+    // swap the last open part into its slot
+    std::uint32_t last = open_.back();
+    open_[s] = last;
+    slot_[last] = s;
+    open_.pop_back();
+    slot_[part] = kNone;
+}
+
+
+void CoverageGrid::close(size_t cell) {
+    closed_[cell] = 1;
+    retire(static_cast<std::uint32_t>(cell));
+}
+
+
+bool CoverageGrid::covered(const RVector2& pos) const {
+    if (!bounds_.contains(pos)) return false;
+
+    int i = std::min(cols_ - 1, static_cast<int>((pos.x - bounds_.min.x)/cell_size_));
+    int j = std::min(rows_ - 1, static_cast<int>((pos.y - bounds_.min.y)/cell_size_));
+
+    return closed_[static_cast<size_t>(j)*cols_ + i];
+}
+
+
+// a disk holds a box when it holds the box's four corners
+static bool disk_contains(const RVector2& centre, real radius2, const Box<real>& box) {
+    real dx = std::max(centre.x - box.min.x, box.max.x - centre.x);
+    real dy = std::max(centre.y - box.min.y, box.max.y - centre.y);
+    return dx*dx + dy*dy <= radius2;
+}
+
+
+void CoverageGrid::cover(std::uint32_t part, const RVector2& pos, real radius2) {
+    const Part& p = parts_[part];
+
+    if (disk_contains(pos, radius2, p.box)) {
+        retire(part);
+    } else if (p.children != kNone) {
+        for (std::uint32_t c=p.children; c<p.children+4; ++c) cover(c, pos, radius2);
+    }
+}
+
+
+void CoverageGrid::cover(const RVector2& pos, real radius) {
+    if (cols_ == 0 || rows_ == 0) return;
+
+    RVector2 lo = (pos - bounds_.min - RVector2{radius, radius})/cell_size_;
+    RVector2 hi = (pos - bounds_.min + RVector2{radius, radius})/cell_size_;
+
+    int i0 = std::max(0, static_cast<int>(std::floor(lo.x)));
+    int j0 = std::max(0, static_cast<int>(std::floor(lo.y)));
+    int i1 = std::min(cols_ - 1, static_cast<int>(std::floor(hi.x)));
+    int j1 = std::min(rows_ - 1, static_cast<int>(std::floor(hi.y)));
+
+    real radius2 = radius*radius;
+
+    for (int j=j0; j<=j1; ++j) {
+        for (int i=i0; i<=i1; ++i) {
+            size_t cell = static_cast<size_t>(j)*cols_ + i;
+            if (closed_[cell]) continue;
+
+            // a cell only closes for a point that covers all of it, corners
+            // covered by different points can leave a gap between them
+            if (disk_contains(pos, radius2, parts_[cell].box)) {
+                close(cell);
+            } else {
+                cover(static_cast<std::uint32_t>(cell), pos, radius2);
+            }
+        }
+    }
+}
+
+
+RVector2 CoverageGrid::draw(CounterRng& rng) {
+    assert(!saturated());
+
+    std::uint32_t part = open_[rng.below(open_.size())];
+    const Box<real>& box = parts_[part].box;
+
+    // drawn in double, the same seeds in either precision
+    RVector2 pos = {
+        static_cast<real>(rng.unit()*box.width()  + box.min.x),
+        static_cast<real>(rng.unit()*box.height() + box.min.y)
+    };
+
+    last_ = part;
+    if (++parts_[part].draws >= kDrawsPerPart) retire(part);
+
+    return pos;
+}
+
+
+void CoverageGrid::reject(const std::function<bool(const Box<real>&)>& contained) {
+    assert(last_ != kNone);
+
+    std::uint32_t part = last_;
+    last_ = kNone;
+
+    retire(part);
+
+    Part p = parts_[part];
+    if (p.depth >= kMaxDepth) return;
+
+    RVector2 mid = middle(p.box.min, p.box.max);
+    Box<real> quarters[4] = {
+        Box<real>(p.box.min, mid),
+        Box<real>({mid.x, p.box.min.y}, {p.box.max.x, mid.y}),
+        Box<real>({p.box.min.x, mid.y}, {mid.x, p.box.max.y}),
+        Box<real>(mid, p.box.max)
+    };
+
+    auto children = static_cast<std::uint32_t>(parts_.size());
+    parts_[part].children = children;
+
+    for (const Box<real>& quarter : quarters) {
+        auto child = static_cast<std::uint32_t>(parts_.size());
+        parts_.push_back({quarter, kNone, static_cast<unsigned char>(p.depth + 1),
+            static_cast<unsigned char>(p.draws - 1)});
+        slot_.push_back(kNone);
+
+        if (!contained(quarter)) open(child);
+    }
+}
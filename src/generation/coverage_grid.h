@@ -0,0 +1,77 @@
+#ifndef COVERAGE_GRID_H
+#define COVERAGE_GRID_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "../types.h"
+#include "counter_rng.h"
+
+
+// the part of a rectangle still open to seeds, as a grid of cells. a cell
+// closes once it lies within the radius of a single road point, or it is
+// blocked. a seed drawn from an open part and rejected splits the part in
+// quarters, and only the quarters the caller does not find covered stay
+// open, down to an eighth of a cell. a part also closes after a few seeds
+// drawn from it were free, made a road or not. seeds are drawn from the
+// open parts only, so the sampler is saturated exactly when none is left.
+// gaps between roads narrower than the smallest part may be lost.
+class CoverageGrid {
+private:
+    static constexpr int kDrawsPerPart = 3;
+    static constexpr int kMaxDepth = 3; // quarters of quarters of quarters
+    static constexpr std::uint32_t kNone = -1;
+
+    struct Part {
+        Box<real> box;
+        std::uint32_t children = kNone; // the first of its four quarters
+        unsigned char depth = 0;
+        unsigned char draws = 0;
+    };
+
+    Box<real> bounds_;
+    real cell_size_ = 1;
+    int cols_ = 0;
+    int rows_ = 0;
+
+    std::vector<Part> parts_;           // the cells, then quarters as split
+    std::vector<std::uint32_t> open_;   // ids of the open parts, unordered
+    std::vector<std::uint32_t> slot_;   // index of each part in open_, or kNone
+    std::vector<unsigned char> closed_; // cells closed as a whole
+    std::uint32_t last_ = kNone;        // part of the last draw
+
+    void open(std::uint32_t part);
+    void retire(std::uint32_t part);
+    void cover(std::uint32_t part, const RVector2& pos, real radius2);
+
+public:
+    // all of bounds open, in cells of cell_size
+    void reset(const Box<real>& bounds, real cell_size);
+
+    size_t cell_count() const;
+    size_t open_count() const;
+    bool saturated() const;
+
+    Box<real> cell_box(size_t cell) const;
+
+    // marks a cell covered as a whole, e.g. blocked by an obstacle
+    void close(size_t cell);
+
+    // pos is in a covered cell. cheap, seeds there need no further check.
+    bool covered(const RVector2& pos) const;
+
+    // closes the parts within radius of pos
+    void cover(const RVector2& pos, real radius);
+
+    // a uniform point in a uniformly chosen open part, counted as a draw
+    // from that part. not saturated() is required.
+    RVector2 draw(CounterRng& rng);
+
+    // the last point drawn was not free: splits its part in quarters and
+    // keeps those open that contained(quarter) is false for. a part of the
+    // smallest size closes instead.
+    void reject(const std::function<bool(const Box<real>&)>& contained);
+};
+
+#endif
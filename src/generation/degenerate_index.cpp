@@ -0,0 +1,103 @@
+#include "degenerate_index.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+static bool by_x(const RVector2& l, const RVector2& r) {
+    return l.x < r.x;
+}
+
+
+DegenerateIndex::DegenerateIndex(const TensorField* field, real cell_size) :
+    field_(field),
+    cell_size_(cell_size)
+{
+    assert(cell_size_ > 0.0);
+}
+
+
+bool DegenerateIndex::is_stale(const Box<real>& bounds) const {
+    return !built_
+        || built_version_ != field_->version()
+        || !(bounds == bounds_);
+}
+
+
+void DegenerateIndex::invalidate() {
+    built_ = false;
+}
+
+
+// grow region to whole cells of the lattice anchored at bounds_.min, so a
+// partial search finds exactly what a full one would
+Box<real> DegenerateIndex::snap(const Box<real>& region) const {
+    Box<real> clipped = region & bounds_;
+
+    RVector2 lo = (clipped.min - bounds_.min)/cell_size_;
+    RVector2 hi = (clipped.max - bounds_.min)/cell_size_;
+
+    RVector2 min = bounds_.min + RVector2{
+        std::floor(lo.x)*cell_size_, std::floor(lo.y)*cell_size_
+    };
+    RVector2 max = bounds_.min + RVector2{
+        std::ceil(hi.x)*cell_size_, std::ceil(hi.y)*cell_size_
+    };
+
+    return Box(min, max) & bounds_;
+}
+
+
+void DegenerateIndex::research(const Box<real>& region) {
+    if (!(region.min.x < region.max.x) || !(region.min.y < region.max.y))
+        return;
+
+    std::erase_if(points_, [&region](const RVector2& p) {
+        return region.contains(p);
+    });
+
+    std::vector<RVector2> found = field_->degenerate_points(region, cell_size_);
+    points_.insert(points_.end(), found.begin(), found.end());
+}
+
+
+void DegenerateIndex::update(const Box<real>& bounds) {
+    if (!is_stale(bounds)) return;
+
+    std::optional<std::vector<Box<real>>> dirty;
+    if (built_ && bounds == bounds_) dirty = field_->dirty_since(built_version_);
+
+    if (dirty.has_value()) {
+        for (const Box<real>& region : dirty.value()) {
+            research(snap(region));
+        }
+    } else {
+        bounds_ = bounds;
+        points_ = field_->degenerate_points(bounds_, cell_size_);
+    }
+
+    std::sort(points_.begin(), points_.end(), by_x);
+
+    built_version_ = field_->version();
+    built_ = true;
+}
+
+
+const std::vector<RVector2>& DegenerateIndex::points() const {
+    return points_;
+}
+
+
+bool DegenerateIndex::near(const RVector2& pos, real radius) const {
+    real radius2 = radius*radius;
+
+    auto it = std::lower_bound(points_.begin(), points_.end(),
+        RVector2{pos.x - radius, pos.y}, by_x);
+
+    for (; it != points_.end() && it->x < pos.x + radius; ++it) {
+        RVector2 diff = *it - pos;
+        if (dot_product(diff, diff) < radius2) return true;
+    }
+
+    return false;
+}
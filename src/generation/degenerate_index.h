@@ -0,0 +1,45 @@
+#ifndef DEGENERATE_INDEX_H
+#define DEGENERATE_INDEX_H
+
+#include <cstdint>
+#include <vector>
+
+#include "../types.h"
+#include "tensor_field.h"
+
+
+// degenerate points of a TensorField over a rectangle. streamlines spiral
+// around these instead of passing them, so the generator stops tracing
+// near them and does not seed there. points are kept sorted by x, there are
+// few enough of them that a sweep over the x range is cheap.
+class DegenerateIndex {
+private:
+    const TensorField* field_;
+    real cell_size_;
+
+    Box<real> bounds_;
+    std::vector<RVector2> points_;
+
+    std::uint64_t built_version_ = 0;
+    bool built_ = false;
+
+    Box<real> snap(const Box<real>& region) const;
+    void research(const Box<real>& region);
+
+public:
+    DegenerateIndex(const TensorField* field, real cell_size);
+
+    bool is_stale(const Box<real>& bounds) const;
+
+    // searches again if the field was edited or bounds changed. edits
+    // within unchanged bounds only search their dirty regions.
+    void update(const Box<real>& bounds);
+    void invalidate();
+
+    const std::vector<RVector2>& points() const;
+
+    // is any degenerate point closer than radius to pos
+    bool near(const RVector2& pos, real radius) const;
+};
+
+#endif
@@ -0,0 +1,150 @@
+#include "field_index.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+BasisFieldIndex::BasisFieldIndex(real cell_size) :
+    cell_size_(cell_size)
+{
+    assert(cell_size_ > 0.0);
+}
+
+
+std::uint64_t BasisFieldIndex::key(int cx, int cy) {
+    return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(cx)) << 32)
+        | static_cast<std::uint32_t>(cy);
+}
+
+
+int BasisFieldIndex::cell_coord(real v) const {
+    return static_cast<int>(std::floor(v/cell_size_));
+}
+
+
+BasisFieldIndex::CellRange
+BasisFieldIndex::cell_range(const Box<real>& bbox) const {
+    return {
+        cell_coord(bbox.min.x),
+        cell_coord(bbox.min.y),
+        cell_coord(bbox.max.x),
+        cell_coord(bbox.max.y),
+        false
+    };
+}
+
+
+void BasisFieldIndex::link(std::uint32_t idx) {
+    const CellRange& r = ranges_[idx];
+
+    if (r.global) {
+        global_.push_back(idx);
+        return;
+    }
+
+    for (int cx=r.x0; cx<=r.x1; ++cx) {
+        for (int cy=r.y0; cy<=r.y1; ++cy) {
+            cells_[key(cx, cy)].push_back(idx);
+        }
+    }
+}
+
+
+void BasisFieldIndex::unlink(std::uint32_t idx) {
+    const CellRange& r = ranges_[idx];
+
+    if (r.global) {
+        global_.erase(std::find(global_.begin(), global_.end(), idx));
+        return;
+    }
+
+    for (int cx=r.x0; cx<=r.x1; ++cx) {
+        for (int cy=r.y0; cy<=r.y1; ++cy) {
+            auto it = cells_.find(key(cx, cy));
+            assert(it != cells_.end());
+
+            std::vector<std::uint32_t>& bucket = it->second;
+            bucket.erase(std::find(bucket.begin(), bucket.end(), idx));
+
+            if (bucket.empty()) cells_.erase(it);
+        }
+    }
+}
+
+
+BasisFieldIndex::CellRange
+BasisFieldIndex::disc_range(const RVector2& centre, real size) const {
+    if (size <= 0) return {0, 0, 0, 0, true};
+
+    RVector2 half_diag = {size, size};
+    return cell_range(Box(centre - half_diag, centre + half_diag));
+}
+
+
+void BasisFieldIndex::insert(size_t idx, const RVector2& centre, real size) {
+    assert(idx == ranges_.size());
+    ranges_.push_back(disc_range(centre, size));
+    link(idx);
+}
+
+
+void BasisFieldIndex::update(size_t idx, const RVector2& centre, real size) {
+    assert(idx < ranges_.size());
+
+    CellRange r = disc_range(centre, size);
+    const CellRange& old = ranges_[idx];
+
+    // edits that stay within the same cells are free
+    if (r.global == old.global && (r.global || (r.x0 == old.x0 &&
+        r.y0 == old.y0 && r.x1 == old.x1 && r.y1 == old.y1)))
+        return;
+
+    unlink(idx);
+    ranges_[idx] = r;
+    link(idx);
+}
+
+
+void BasisFieldIndex::clear() {
+    global_.clear();
+    ranges_.clear();
+    cells_.clear();
+}
+
+
+size_t BasisFieldIndex::size() const {
+    return ranges_.size();
+}
+
+
+bool BasisFieldIndex::same_cell(const RVector2& a, const RVector2& b) const {
+    return cell_coord(a.x) == cell_coord(b.x)
+        && cell_coord(a.y) == cell_coord(b.y);
+}
+
+
+const std::vector<std::uint32_t>& BasisFieldIndex::global() const {
+    return global_;
+}
+
+
+void BasisFieldIndex::query(const Box<real>& bbox,
+    std::vector<std::uint32_t>& out, bool with_global) const
+{
+    out.clear();
+    if (with_global) out.assign(global_.begin(), global_.end());
+
+    CellRange r = cell_range(bbox);
+
+    for (int cx=r.x0; cx<=r.x1; ++cx) {
+        for (int cy=r.y0; cy<=r.y1; ++cy) {
+            auto it = cells_.find(key(cx, cy));
+            if (it == cells_.end()) continue;
+
+            out.insert(out.end(), it->second.begin(), it->second.end());
+        }
+    }
+
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
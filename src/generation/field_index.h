@@ -0,0 +1,87 @@
+#ifndef FIELD_INDEX_H
+#define FIELD_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "../types.h"
+
+
+// uniform grid over the influence discs of basis fields. a field of size s
+// at c can only contribute inside |p - c| < s, so it is registered in every
+// cell its disc's bounding box touches. fields with size 0 have infinite
+// support and are always reported.
+class BasisFieldIndex {
+private:
+    struct CellRange {
+        int x0, y0, x1, y1; // inclusive
+        bool global;
+    };
+
+    real cell_size_;
+    std::vector<std::uint32_t> global_;
+    std::vector<CellRange> ranges_; // by field index
+    std::unordered_map<std::uint64_t, std::vector<std::uint32_t>> cells_;
+
+    static std::uint64_t key(int cx, int cy);
+    int cell_coord(real v) const;
+    CellRange cell_range(const Box<real>& bbox) const;
+    CellRange disc_range(const RVector2& centre, real size) const;
+
+    void link(std::uint32_t idx);
+    void unlink(std::uint32_t idx);
+
+public:
+    BasisFieldIndex(real cell_size);
+
+    // field idx must be appended in order, i.e. idx == size()
+    void insert(size_t idx, const RVector2& centre, real size);
+    void update(size_t idx, const RVector2& centre, real size);
+    void clear();
+
+    size_t size() const;
+    bool same_cell(const RVector2& a, const RVector2& b) const;
+
+    // size 0 fields, in insertion order
+    const std::vector<std::uint32_t>& global() const;
+
+    // calls func(idx) for every field that can be nonzero at pos. callers
+    // that aggregate size 0 fields themselves pass with_global = false.
+    template<typename Func>
+    void for_each_at(const RVector2& pos, Func&& func,
+        bool with_global = true) const
+    {
+        if (with_global) {
+            for (std::uint32_t idx : global_) func(idx);
+        }
+
+        auto it = cells_.find(key(cell_coord(pos.x), cell_coord(pos.y)));
+        if (it == cells_.end()) return;
+
+        for (std::uint32_t idx : it->second) func(idx);
+    }
+
+    // fields that can be nonzero anywhere in bbox, sorted and unique
+    void query(const Box<real>& bbox, std::vector<std::uint32_t>& out,
+        bool with_global = true) const;
+
+    // calls func(idx) for every field that can be nonzero in [lo, hi].
+    // scratch is only touched when the box spans several cells.
+    template<typename Func>
+    void for_each_in(const RVector2& lo, const RVector2& hi,
+        std::vector<std::uint32_t>& scratch, Func&& func,
+        bool with_global = true) const
+    {
+        if (same_cell(lo, hi)) {
+            for_each_at(lo, func, with_global);
+            return;
+        }
+
+        query(Box(lo, hi), scratch, with_global);
+        for (std::uint32_t idx : scratch) func(idx);
+    }
+};
+
+#endif
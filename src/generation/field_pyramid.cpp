@@ -0,0 +1,269 @@
+#include "field_pyramid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+
+static bool overlaps(const Box<real>& a, const Box<real>& b) {
+    return a.min.x < b.max.x && b.min.x < a.max.x
+        && a.min.y < b.max.y && b.min.y < a.max.y;
+}
+
+
+size_t FieldPyramid::TileKeyHash::operator()(const TileKey& k) const {
+    size_t h = std::hash<int>()(k.level);
+    h = h*31 + std::hash<int>()(k.tx);
+    h = h*31 + std::hash<int>()(k.ty);
+    return h;
+}
+
+
+FieldPyramid::FieldPyramid(const TensorField* field, real base_cell,
+    int levels, int thread_count) :
+    field_(field),
+    base_cell_(base_cell),
+    levels_(levels)
+{
+    assert(base_cell_ > 0 && levels_ > 0);
+
+    if (thread_count <= 0) {
+        thread_count = std::max(1,
+            static_cast<int>(std::thread::hardware_concurrency()) - 1);
+    }
+
+    for (int i=0; i<thread_count; ++i) {
+        workers_.emplace_back(&FieldPyramid::worker_loop, this);
+    }
+}
+
+
+FieldPyramid::~FieldPyramid() {
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    jobs_cv_.notify_all();
+
+    for (std::thread& w : workers_) w.join();
+}
+
+
+int FieldPyramid::level_count() const {
+    return levels_;
+}
+
+
+real FieldPyramid::cell_size(int level) const {
+    return std::ldexp(base_cell_, level);
+}
+
+
+real FieldPyramid::tile_size(int level) const {
+    return cell_size(level)*kTileCells;
+}
+
+
+FieldPyramid::TileKey FieldPyramid::key_at(const RVector2& pos, int level) const {
+    real size = tile_size(level);
+    return {
+        level,
+        static_cast<int>(std::floor(pos.x/size)),
+        static_cast<int>(std::floor(pos.y/size))
+    };
+}
+
+
+Box<real> FieldPyramid::tile_bbox(const TileKey& key) const {
+    real size = tile_size(key.level);
+    RVector2 min = {key.tx*size, key.ty*size};
+
+    return Box(min, min + RVector2{size, size});
+}
+
+
+int FieldPyramid::level_for(real spacing) const {
+    if (spacing <= base_cell_) return 0;
+
+    int level = static_cast<int>(std::floor(std::log2(spacing/base_cell_)));
+    return std::clamp(level, 0, levels_-1);
+}
+
+
+void FieldPyramid::sync_snapshot() {
+    std::uint64_t version = field_->version();
+    if (snapshot_ != nullptr && version == snapshot_version_) return;
+
+    if (snapshot_ != nullptr) {
+        auto dirty = field_->dirty_since(snapshot_version_);
+
+        std::lock_guard lock(mutex_);
+        for (auto& [key, tile] : tiles_) {
+            bool touched = !dirty.has_value();
+
+            if (!touched) {
+                Box<real> bbox = tile_bbox(key);
+                touched = std::any_of(dirty->begin(), dirty->end(),
+                    [&bbox](const Box<real>& r) { return overlaps(r, bbox); });
+            }
+
+            // keep the stale data on screen until the rebake lands
+            if (touched) tile.dirty_version = version;
+        }
+    }
+
+    snapshot_ = std::make_shared<const TensorField>(*field_);
+    snapshot_version_ = version;
+}
+
+
+void FieldPyramid::schedule(const Box<real>& view, int level) {
+    int fallback = std::min(level+2, levels_-1);
+
+    std::lock_guard lock(mutex_);
+
+    // requests from earlier frames are superseded by this one
+    jobs_.clear();
+
+    for (int l : {level, fallback}) {
+        TileKey lo = key_at(view.min, l);
+        TileKey hi = key_at(view.max, l);
+
+        for (int tx=lo.tx; tx<=hi.tx; ++tx) {
+            for (int ty=lo.ty; ty<=hi.ty; ++ty) {
+                TileKey key = {l, tx, ty};
+                Tile& tile = tiles_[key];
+                tile.last_used = frame_;
+
+                bool fresh = tile.data != nullptr
+                    && tile.data_version >= tile.dirty_version;
+
+                if (!fresh && !tile.in_flight) {
+                    jobs_.push_back({key, snapshot_, snapshot_version_});
+                }
+            }
+        }
+
+        if (l == fallback) break;
+    }
+
+    jobs_cv_.notify_all();
+}
+
+
+void FieldPyramid::evict() {
+    std::lock_guard lock(mutex_);
+    if (tiles_.size() <= kMaxTiles) return;
+
+    std::erase_if(tiles_, [this](const auto& entry) {
+        const Tile& tile = entry.second;
+        return !tile.in_flight && tile.last_used + kKeepFrames < frame_;
+    });
+}
+
+
+void FieldPyramid::request(const Box<real>& view, int level) {
+    ++frame_;
+    level = std::clamp(level, 0, levels_-1);
+
+    sync_snapshot();
+    schedule(view, level);
+    evict();
+}
+
+
+void FieldPyramid::worker_loop() {
+    std::unique_lock lock(mutex_);
+
+    while (true) {
+        jobs_cv_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+        if (stop_) return;
+
+        Job job = std::move(jobs_.back());
+        jobs_.pop_back();
+
+        Tile& tile = tiles_[job.key];
+        bool fresh = tile.data != nullptr
+            && tile.data_version >= tile.dirty_version;
+
+        if (tile.in_flight || fresh) continue;
+        tile.in_flight = true;
+
+        lock.unlock();
+        std::shared_ptr<const TileData> data = bake(job);
+        lock.lock();
+
+        // the tile cannot be evicted while in flight
+        Tile& done = tiles_[job.key];
+        done.in_flight = false;
+
+        if (done.data == nullptr || job.version >= done.data_version) {
+            done.data = std::move(data);
+            done.data_version = job.version;
+        }
+    }
+}
+
+
+std::shared_ptr<const FieldPyramid::TileData>
+FieldPyramid::bake(const Job& job) const {
+    constexpr int side = kTileCells+1;
+    constexpr size_t n = side*side;
+
+    RVector2 origin = tile_bbox(job.key).min;
+    real cell = cell_size(job.key.level);
+
+    std::vector<real> xs(n), ys(n);
+    for (int j=0; j<side; ++j) {
+        for (int i=0; i<side; ++i) {
+            xs[j*side + i] = origin.x + i*cell;
+            ys[j*side + i] = origin.y + j*cell;
+        }
+    }
+
+    auto data = std::make_shared<TileData>();
+    data->a.resize(n);
+    data->b.resize(n);
+
+    std::vector<RVector2> major(n), minor(n);
+    job.snapshot->sample_batch(xs, ys, data->a, data->b, major, minor);
+
+    return data;
+}
+
+
+bool FieldPyramid::sample(const RVector2& pos, int level, Tensor& out) const {
+    constexpr int side = kTileCells+1;
+
+    std::lock_guard lock(mutex_);
+
+    for (int l=std::max(level, 0); l<levels_; ++l) {
+        TileKey key = key_at(pos, l);
+
+        auto it = tiles_.find(key);
+        if (it == tiles_.end() || it->second.data == nullptr) continue;
+
+        const TileData& data = *it->second.data;
+
+        RVector2 local = (pos - tile_bbox(key).min)/cell_size(l);
+        int i = std::clamp(static_cast<int>(local.x), 0, kTileCells-1);
+        int j = std::clamp(static_cast<int>(local.y), 0, kTileCells-1);
+
+        real fx = local.x - i;
+        real fy = local.y - j;
+
+        auto lerp2 = [&](const std::vector<real>& v) {
+            const real* row0 = v.data() + j*side + i;
+            const real* row1 = row0 + side;
+
+            real top    = row0[0] + (row0[1]-row0[0])*fx;
+            real bottom = row1[0] + (row1[1]-row1[0])*fx;
+            return top + (bottom-top)*fy;
+        };
+
+        out = Tensor::from_a_b(lerp2(data.a), lerp2(data.b));
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,109 @@
+#ifndef FIELD_PYRAMID_H
+#define FIELD_PYRAMID_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "../types.h"
+#include "tensor_field.h"
+
+
+// multi-resolution cache of a TensorField for display. level L stores the
+// (a, b) components on a lattice of spacing base_cell * 2^L, cut into
+// world-space tiles that are baked on background threads against a
+// snapshot of the field. a view asks for the level matching its glyph
+// spacing; tiles that are not baked yet fall back to coarser levels.
+class FieldPyramid {
+private:
+    static constexpr int kTileCells = 32; // lattice cells per tile side
+    static constexpr size_t kMaxTiles = 2048;
+    static constexpr std::uint64_t kKeepFrames = 120;
+
+    struct TileKey {
+        int level;
+        int tx;
+        int ty;
+
+        bool operator==(const TileKey& other) const = default;
+    };
+
+    struct TileKeyHash {
+        size_t operator()(const TileKey& k) const;
+    };
+
+    struct TileData {
+        std::vector<real> a; // (kTileCells+1)^2, row major
+        std::vector<real> b;
+    };
+
+    struct Tile {
+        std::shared_ptr<const TileData> data;
+        std::uint64_t data_version = 0;  // field version data was baked at
+        std::uint64_t dirty_version = 0; // field version of the last edit touching it
+        std::uint64_t last_used = 0;     // frame
+        bool in_flight = false;
+    };
+
+    struct Job {
+        TileKey key;
+        std::shared_ptr<const TensorField> snapshot;
+        std::uint64_t version;
+    };
+
+    const TensorField* field_;
+    real base_cell_;
+    int levels_;
+
+    std::shared_ptr<const TensorField> snapshot_;
+    std::uint64_t snapshot_version_ = 0;
+    std::uint64_t frame_ = 0;
+
+    mutable std::mutex mutex_; // guards tiles_, jobs_, stop_
+    std::condition_variable jobs_cv_;
+    std::unordered_map<TileKey, Tile, TileKeyHash> tiles_;
+    std::vector<Job> jobs_; // stack, most urgent last
+    bool stop_ = false;
+
+    std::vector<std::thread> workers_;
+
+    real cell_size(int level) const;
+    real tile_size(int level) const;
+    TileKey key_at(const RVector2& pos, int level) const;
+    Box<real> tile_bbox(const TileKey& key) const;
+
+    void sync_snapshot();
+    void schedule(const Box<real>& view, int level);
+    void evict();
+
+    void worker_loop();
+    std::shared_ptr<const TileData> bake(const Job& job) const;
+
+public:
+    FieldPyramid(const TensorField* field, real base_cell, int levels,
+        int thread_count = 0);
+    ~FieldPyramid();
+
+    FieldPyramid(const FieldPyramid&) = delete;
+    FieldPyramid& operator=(const FieldPyramid&) = delete;
+
+    int level_count() const;
+
+    // coarsest level whose lattice is no coarser than spacing
+    int level_for(real spacing) const;
+
+    // main thread, once per frame: picks up field edits and queues the
+    // tiles covering view at level (and a coarser fallback)
+    void request(const Box<real>& view, int level);
+
+    // bilinear sample from the finest baked level >= level. false if no
+    // level covering pos has been baked yet.
+    bool sample(const RVector2& pos, int level, Tensor& out) const;
+};
+
+#endif
@@ -0,0 +1,171 @@
+#include "field_raster.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+
+FieldRaster::FieldRaster(const TensorField* field, real cell_size) :
+    field_(field),
+    cell_size_(cell_size)
+{
+    assert(cell_size_ > 0.0);
+}
+
+
+real FieldRaster::get_cell_size() const {
+    return cell_size_;
+}
+
+
+void FieldRaster::set_cell_size(real cell_size) {
+    assert(cell_size > 0.0);
+    if (cell_size == cell_size_) return;
+
+    cell_size_ = cell_size;
+    invalidate();
+}
+
+
+const Box<real>& FieldRaster::get_bounds() const {
+    return bounds_;
+}
+
+
+void FieldRaster::set_bake_threads(int threads) {
+    bake_threads_ = std::max(0, threads);
+}
+
+
+bool FieldRaster::is_stale(const Box<real>& bounds) const {
+    return !built_
+        || built_version_ != field_->version()
+        || !(bounds == bounds_);
+}
+
+
+void FieldRaster::invalidate() {
+    built_ = false;
+}
+
+
+void FieldRaster::bake_block(int col_begin, int col_end,
+    int row_begin, int row_end)
+{
+    for (int j=row_begin; j<row_end; ++j) {
+        for (int i=col_begin; i<col_end; ++i) {
+            Tensor t = field_->sample(
+                bounds_.min + RVector2{i*cell_size_, j*cell_size_}
+            );
+
+            a_[j*cols_ + i] = t.a;
+            b_[j*cols_ + i] = t.b;
+        }
+    }
+}
+
+
+void FieldRaster::bake_region(int col_begin, int col_end,
+    int row_begin, int row_end)
+{
+    int rows = row_end - row_begin;
+    if (rows <= 0 || col_end <= col_begin) return;
+
+    // rows are independent, split them into contiguous bands per thread
+    int threads = bake_threads_ > 0
+        ? bake_threads_
+        : static_cast<int>(std::thread::hardware_concurrency());
+    int thread_count = std::clamp(threads, 1, rows);
+    int band = (rows + thread_count - 1)/thread_count;
+
+    std::vector<std::thread> workers;
+    for (int t=1; t<thread_count; ++t) {
+        int begin = row_begin + t*band;
+        int end = std::min(row_end, begin+band);
+        if (begin >= end) break;
+
+        workers.emplace_back(&FieldRaster::bake_block, this,
+            col_begin, col_end, begin, end);
+    }
+
+    bake_block(col_begin, col_end, row_begin, std::min(row_end, row_begin+band));
+
+    for (std::thread& w : workers) w.join();
+}
+
+
+void FieldRaster::rebake_dirty(const Box<real>& dirty) {
+    Box<real> clipped = dirty & bounds_;
+    if (clipped.min.x > clipped.max.x || clipped.min.y > clipped.max.y) return;
+
+    RVector2 lo = (clipped.min - bounds_.min)/cell_size_;
+    RVector2 hi = (clipped.max - bounds_.min)/cell_size_;
+
+    bake_region(
+        std::max(0, static_cast<int>(std::floor(lo.x))),
+        std::min(cols_, static_cast<int>(std::ceil(hi.x)) + 1),
+        std::max(0, static_cast<int>(std::floor(lo.y))),
+        std::min(rows_, static_cast<int>(std::ceil(hi.y)) + 1)
+    );
+}
+
+
+void FieldRaster::update(const Box<real>& bounds) {
+    if (!is_stale(bounds)) return;
+
+    if (built_ && bounds == bounds_) {
+        auto dirty = field_->dirty_since(built_version_);
+
+        if (dirty.has_value()) {
+            for (const Box<real>& region : dirty.value()) {
+                rebake_dirty(region);
+            }
+
+            built_version_ = field_->version();
+            return;
+        }
+    }
+
+    bounds_ = bounds;
+    cols_ = static_cast<int>(std::ceil(bounds.width()/cell_size_)) + 1;
+    rows_ = static_cast<int>(std::ceil(bounds.height()/cell_size_)) + 1;
+
+    a_.assign(cols_*rows_, 0.0);
+    b_.assign(cols_*rows_, 0.0);
+
+    bake_region(0, cols_, 0, rows_);
+
+    built_version_ = field_->version();
+    built_ = true;
+}
+
+
+Tensor FieldRaster::sample(const RVector2& pos) const {
+    if (!built_ || !bounds_.contains(pos))
+        return field_->sample(pos);
+
+    RVector2 local = (pos - bounds_.min)/cell_size_;
+
+    int i = std::min(static_cast<int>(local.x), cols_-2);
+    int j = std::min(static_cast<int>(local.y), rows_-2);
+
+    real fx = local.x - i;
+    real fy = local.y - j;
+
+    size_t i00 = j*cols_ + i;
+    size_t i10 = i00 + 1;
+    size_t i01 = i00 + cols_;
+    size_t i11 = i01 + 1;
+
+    auto lerp2 = [fx, fy](const std::vector<real>& v,
+            size_t p00, size_t p10, size_t p01, size_t p11) {
+        real top    = v[p00] + (v[p10]-v[p00])*fx;
+        real bottom = v[p01] + (v[p11]-v[p01])*fx;
+        return top + (bottom-top)*fy;
+    };
+
+    return Tensor::from_a_b(
+        lerp2(a_, i00, i10, i01, i11),
+        lerp2(b_, i00, i10, i01, i11)
+    );
+}
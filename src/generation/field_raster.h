@@ -0,0 +1,55 @@
+#ifndef FIELD_RASTER_H
+#define FIELD_RASTER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "../types.h"
+#include "tensor_field.h"
+
+
+// baked (a, b) components of a TensorField on a regular lattice over a
+// rectangle, sampled bilinearly. samples outside the baked rectangle fall
+// back to the analytic field.
+class FieldRaster {
+private:
+    const TensorField* field_;
+    real cell_size_;
+
+    Box<real> bounds_;
+    int cols_ = 0;
+    int rows_ = 0;
+    std::vector<real> a_; // row major, rows_ x cols_
+    std::vector<real> b_;
+
+    std::uint64_t built_version_ = 0;
+    bool built_ = false;
+    int bake_threads_ = 0;
+
+    void bake_block(int col_begin, int col_end, int row_begin, int row_end);
+    void bake_region(int col_begin, int col_end, int row_begin, int row_end);
+    void rebake_dirty(const Box<real>& dirty);
+
+public:
+    FieldRaster(const TensorField* field, real cell_size);
+
+    real get_cell_size() const;
+    void set_cell_size(real cell_size);
+
+    const Box<real>& get_bounds() const;
+
+    // threads baking a region, 0 uses every hardware thread. 1 for a
+    // raster baked by a thread that is one of many already.
+    void set_bake_threads(int threads);
+
+    bool is_stale(const Box<real>& bounds) const;
+
+    // rebakes (in parallel) if the field was edited or bounds changed.
+    // edits within unchanged bounds only rebake their dirty regions.
+    void update(const Box<real>& bounds);
+    void invalidate();
+
+    Tensor sample(const RVector2& pos) const;
+};
+
+#endif
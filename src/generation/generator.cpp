@@ -1,19 +1,22 @@
 #include "generator.h"
+#include <atomic>
+#include <cmath>
 #include <iostream>
+#include <numeric>
+#include <thread>
 
 GeneratorParameters::GeneratorParameters(
-        int max_seed_retries,
         int max_integration_iterations,
-        double d_sep,
-        double d_test,
-        double d_circle,
-        double dl,
-        double d_lookahead,
-        double theta_max,
-        double epsilon,
-        double node_sep
+        real d_sep,
+        real d_test,
+        real d_circle,
+        real dl,
+        real d_lookahead,
+        real theta_max,
+        real epsilon,
+        real node_sep,
+        std::uint64_t seed
         ) :
-    max_seed_retries(max_seed_retries),
     max_integration_iterations(max_integration_iterations),
     d_sep(d_sep),
     d_sep2(d_sep*d_sep),
@@ -27,57 +30,164 @@ GeneratorParameters::GeneratorParameters(
     theta_max(theta_max),
     epsilon(epsilon),
     node_sep(node_sep),
-    node_sep2(node_sep*node_sep)
+    node_sep2(node_sep*node_sep),
+    seed(seed)
 {}
 
 
 //  SECTION: RoadGenerator
 
-bool RoadGenerator::in_bounds(const DVector2& p) const {
-    return viewport_.contains(p);
+bool RoadGenerator::in_bounds(const RVector2& p) const {
+    return trace_bounds_.contains(p) && !obstacles_.blocked(p);
 }
 
 
-void RoadGenerator::add_candidate_seed(DVector2 pos, Eigenfield ef) {
-    seeds_[ef].push(pos);
+// two candidates closer than the smallest d_sep never both seed a road
+void RoadGenerator::reset_candidates() {
+    real min_sep = params_[0].d_sep;
+    for (size_t i=1; i<road_type_count_; ++i) min_sep = std::min(min_sep, params_[i].d_sep);
+
+    for (CandidateSeeds& candidates : seeds_) candidates.reset(min_sep);
 }
 
 
-std::optional<DVector2> 
-RoadGenerator::get_seed(size_t road, Eigenfield ef) {
-    seed_queue& candidate_queue = seeds_[ef];
+// lower keys are tried first
+real RoadGenerator::seed_key(const RVector2& pos, Eigenfield ef, size_t road) const {
+    switch (seed_order_) {
+    case OpenSpace: {
+        // beyond twice d_sep all candidates are as open
+        real reach = 2*params_[road].d_sep;
+        real nearest2 = reach*reach;
+
+        for (const NodeHandle& h : nearby_points(pos, reach, ef)) {
+            RVector2 diff = get_pos(h) - pos;
+            nearest2 = std::min(nearest2, dot_product(diff, diff));
+        }
+
+        return -nearest2;
+    }
+    case CentreOut: {
+        RVector2 diff = pos - middle(viewport_.min, viewport_.max);
+        return dot_product(diff, diff);
+    }
+    default:
+        return 0;
+    }
+}
+
+
+// the key can walk the quadtree, so it is only computed for candidates
+// the queue keeps
+void RoadGenerator::add_candidate_seed(RVector2 pos, Eigenfield ef, size_t road) {
+    CandidateSeeds& candidates = seeds_[ef];
+    if (!candidates.accepts(pos)) return;
+
+    candidates.push(pos, seed_key(pos, ef, road));
+}
+
 
+// opens trace_bounds_ to seeds of road_type, but for what is covered
+// already: space within d_sep of the roads stored so far, around
+// degenerate points and inside obstacles. the seeds are drawn from a
+// stream of their own per road type, tile and eigenfield.
+void RoadGenerator::reset_coverage(size_t road) {
     const GeneratorParameters& param = params_[road];
+    real cell_size = param.d_sep/kCoverageDivisions;
+    real half_diagonal = cell_size*M_SQRT1_2;
 
+    for (Eigenfield ef : {Eigenfield::major(), Eigenfield::minor()}) {
+        CoverageGrid& grid = coverage_[ef];
+        grid.reset(trace_bounds_, cell_size);
 
-    DVector2 seed;
-    while (!candidate_queue.empty()) {
-        DVector2 seed = candidate_queue.front();
-        candidate_queue.pop();
-        if (!has_nearby_point(seed, param.d_sep, ef)) {
-            return seed;
-        } 
-    }
+        rng_[ef] = CounterRng(CounterRng::key({param.seed, tile_key_, road, static_cast<size_t>(ef)}));
 
+        for (size_t r=0; r<road_type_count_; ++r) {
+            RoadHandle handle {0, r, ef};
 
-    for (int count=0; count<param.max_seed_retries; count++) {
-        seed = DVector2 {
-            dist_(gen_)*viewport_.width()  + viewport_.min.x,
-            dist_(gen_)*viewport_.height() + viewport_.min.y
-        };
+            for (std::uint32_t idx=0; idx<road_count(r, ef); ++idx) {
+                handle.idx = idx;
+                const Road& stored = get_road(handle);
 
+                for (std::uint32_t i=stored.begin; i<stored.end; ++i) {
+                    grid.cover(get_pos({i, handle}), param.d_sep);
+                }
+            }
+        }
+
+        for (const RVector2& p : degenerate_.points()) grid.cover(p, param.d_test);
 
-        if (!has_nearby_point(seed, param.d_sep, ef)) {
-            return seed;
+        if (obstacles_.size() == 0) continue;
+
+        for (size_t cell=0; cell<grid.cell_count(); ++cell) {
+            Box<real> box = grid.cell_box(cell);
+            if (obstacles_.distance(middle(box.min, box.max)) < -half_diagonal) grid.close(cell);
         }
     }
+}
+
+
+// a seed from the candidates left by road ends, else from the space not
+// yet covered. nothing once the coverage grid of ef is saturated.
+std::optional<RVector2> 
+RoadGenerator::get_seed(size_t road, Eigenfield ef) {
+    CandidateSeeds& candidates = seeds_[ef];
+    CoverageGrid& grid = coverage_[ef];
+
+    const GeneratorParameters& param = params_[road];
+
+    auto is_free = [&](const RVector2& seed) {
+        return in_bounds(seed)
+            && !has_nearby_point(seed, param.d_sep, ef)
+            && !degenerate_.near(seed, param.d_test);
+    };
+
+    while (!candidates.empty()) {
+        RVector2 seed = candidates.pop();
+
+        // covered candidates are rejected from the grid, without a tree walk
+        if (!grid.covered(seed) && is_free(seed)) return seed;
+    }
+
+    // no seed in box can be free: a road point is within d_sep, or a
+    // degenerate point within d_test, of all of it, or it is blocked.
+    // points within that much less the half diagonal of the middle are,
+    // others that are may leave the box open to be split further.
+    auto contained = [&](const Box<real>& box) {
+        RVector2 centre = middle(box.min, box.max);
+        RVector2 diagonal = box.max - box.min;
+        real half_diagonal = std::sqrt(dot_product(diagonal, diagonal))/2;
+
+        if (obstacles_.size() > 0 && obstacles_.distance(centre) < -half_diagonal)
+            return true;
+
+        return (param.d_test > half_diagonal
+                && degenerate_.near(centre, param.d_test - half_diagonal))
+            || (param.d_sep > half_diagonal
+                && has_nearby_point(centre, param.d_sep - half_diagonal, ef));
+    };
+
+    while (!grid.saturated()) {
+        RVector2 seed = grid.draw(rng_[ef]);
+        if (is_free(seed)) return seed;
+
+        grid.reject(contained);
+    }
+
     return {};
 }
 
-DVector2 RoadGenerator::get_eigenvector(const DVector2& x,
+Tensor RoadGenerator::sample_field(const RVector2& x) const {
+    count(field_samples_, 1);
+
+    if (use_raster_) return raster_.sample(x);
+    return field_->sample(x);
+}
+
+
+RVector2 RoadGenerator::get_eigenvector(const RVector2& x,
     const Eigenfield& ef) const 
 {
-    Tensor out = field_->sample(x);
+    Tensor out = sample_field(x);
 
     if (ef == Eigenfield::major()) {
         return out.get_major_eigenvector();
@@ -86,36 +196,346 @@ DVector2 RoadGenerator::get_eigenvector(const DVector2& x,
     }
 }
 
-DVector2 RoadGenerator::integrate_rk4(const DVector2& x,
-    const Eigenfield& ef, const double& dl) const 
+RVector2 RoadGenerator::integrate_rk4(const RVector2& x,
+    const Eigenfield& ef, const real& dl) const 
 {
-    DVector2 dx = {dl, dl};
+    RVector2 dx = {dl, dl};
 
-    DVector2 k1 = get_eigenvector(x, ef);
-    DVector2 k2 = get_eigenvector(x + dx/2.0, ef);
-    DVector2 k4 = get_eigenvector(x + dx, ef);
+    if (use_raster_) {
+        RVector2 k1 = get_eigenvector(x, ef);
+        RVector2 k2 = get_eigenvector(x + dx/2.0, ef);
+        RVector2 k4 = get_eigenvector(x + dx, ef);
 
-    return k1 + k2*4.0 + k4/6.0;
+        return k1 + k2*4.0 + k4/6.0;
+    }
+
+    // the stage positions do not depend on each other, so sample them together
+    real xs[3] = {x.x, x.x + dx.x/2, x.x + dx.x};
+    real ys[3] = {x.y, x.y + dx.y/2, x.y + dx.y};
+    real a[3], b[3];
+    RVector2 major[3], minor[3];
+
+    field_->sample_batch(xs, ys, a, b, major, minor);
+    count(field_samples_, 3);
+
+    const RVector2* k = ef == Eigenfield::major() ? major : minor;
+
+    return k[0] + k[1]*4.0 + k[2]/6.0;
 }
 
 
 
-void RoadGenerator::extend_road(
+// Dormand-Prince 5(4), the last stage is the slope at the step's end
+static constexpr real kDopriA[7][6] = {
+    {},
+    {1.0/5},
+    {3.0/40,       9.0/40},
+    {44.0/45,      -56.0/15,      32.0/9},
+    {19372.0/6561, -25360.0/2187, 64448.0/6561, -212.0/729},
+    {9017.0/3168,  -355.0/33,     46732.0/5247, 49.0/176,  -5103.0/18656},
+    {35.0/384,     0,             500.0/1113,   125.0/192, -2187.0/6784,  11.0/84}
+};
+
+// fifth minus fourth order weights
+static constexpr real kDopriE[7] = {
+    71.0/57600, 0, -71.0/16695, 71.0/1920, -17253.0/339200, 22.0/525, -1.0/40
+};
+
+
+std::uint64_t RoadGenerator::Wavefront::cell_of(const RVector2& pos) {
+    auto cx = static_cast<std::int32_t>(std::floor(pos.x/kWavefrontCell));
+    auto cy = static_cast<std::int32_t>(std::floor(pos.y/kWavefrontCell));
+
+    return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(cx)) << 32)
+        | static_cast<std::uint32_t>(cy);
+}
+
+
+void RoadGenerator::Wavefront::clear() {
+    xs.clear();
+    ys.clear();
+    runs.clear();
+}
+
+
+// fronts are begun in cell order, a front in a new cell starts a new run
+void RoadGenerator::Wavefront::begin_front(const RVector2& pos) {
+    std::uint64_t c = cell_of(pos);
+
+    if (runs.empty() || (c != cell && runs.back() != xs.size())) {
+        runs.push_back(xs.size());
+    }
+    cell = c;
+}
+
+
+void RoadGenerator::Wavefront::push(const RVector2& pos) {
+    xs.push_back(pos.x);
+    ys.push_back(pos.y);
+}
+
+
+size_t RoadGenerator::Wavefront::size() const {
+    return xs.size();
+}
+
+
+RVector2 RoadGenerator::Wavefront::eigenvector(size_t i, Eigenfield ef) const {
+    return ef == Eigenfield::major() ? major[i] : minor[i];
+}
+
+
+// both eigenvectors at every position of w, left in w.major and w.minor
+void RoadGenerator::sample_eigenvectors(Wavefront& w) const {
+    size_t n = w.size();
+    count(field_samples_, n);
+
+    w.a.resize(n);
+    w.b.resize(n);
+    w.major.resize(n);
+    w.minor.resize(n);
+
+    if (use_raster_) {
+        for (size_t i=0; i<n; ++i) {
+            Tensor t = raster_.sample({w.xs[i], w.ys[i]});
+            w.major[i] = t.get_major_eigenvector();
+            w.minor[i] = t.get_minor_eigenvector();
+        }
+        return;
+    }
+
+    for (size_t r=0; r<w.runs.size(); ++r) {
+        size_t begin = w.runs[r];
+        size_t end = r+1 < w.runs.size() ? w.runs[r+1] : n;
+
+        field_->sample_batch(
+            std::span<const real>(w.xs).subspan(begin, end-begin),
+            std::span<const real>(w.ys).subspan(begin, end-begin),
+            std::span<real>(w.a).subspan(begin, end-begin),
+            std::span<real>(w.b).subspan(begin, end-begin),
+            std::span<RVector2>(w.major).subspan(begin, end-begin),
+            std::span<RVector2>(w.minor).subspan(begin, end-begin)
+        );
+    }
+}
+
+
+// error control of a Dormand-Prince step of size h with stages k. true if
+// the step is taken, with h_next the size to try next, else h is shrunk.
+bool RoadGenerator::accept_dormand_prince(size_t road,
+    const std::array<RVector2, 7>& k, real& h, real& h_next) const
+{
+    const GeneratorParameters& param = params_[road];
+
+    real spacing = std::min(param.node_sep, param.d_test/2);
+    real h_max = spacing*kMaxStepPoints;
+    real h_min = spacing/kMaxStepPoints;
+    real tol = param.epsilon*kStepTolerance;
+
+    RVector2 err;
+    for (int j=0; j<7; ++j) err = err + k[j]*(h*kDopriE[j]);
+
+    real e = std::hypot(err.x, err.y);
+    real scale = e > 0 ? 0.9*std::pow(tol/e, real(0.2)) : 5;
+    scale = std::clamp(scale, real(0.2), real(5));
+
+    if (e <= tol || h <= h_min) {
+        h_next = std::clamp(h*scale, h_min, h_max);
+        return true;
+    }
+
+    count(steps_rejected_, 1);
+    h = std::max(h*scale, h_min);
+    return false;
+}
+
+
+// queues the points of a taken step in res.ahead at output spacing (cubic
+// Hermite between its ends, no further samples)
+void RoadGenerator::emit_dormand_prince(Integration& res, size_t road,
+    const RVector2& x, const std::array<RVector2, 7>& k, real h, real h_next) const
+{
+    count(steps_taken_, 1);
+
+    const GeneratorParameters& param = params_[road];
+    real spacing = std::min(param.node_sep, param.d_test/2);
+
+    RVector2 x1 = x;
+    for (int j=0; j<6; ++j) x1 = x1 + k[j]*(h*kDopriA[6][j]);
+
+    int n = std::max(1, static_cast<int>(std::ceil(h/spacing)));
+
+    res.ahead.clear();
+    res.next_ahead = 0;
+
+    for (int i=1; i<n; ++i) {
+        real t = static_cast<real>(i)/n;
+        real t2 = t*t;
+        real t3 = t2*t;
+
+        res.ahead.push_back(
+              x*(2*t3 - 3*t2 + 1)
+            + k[0]*(h*(t3 - 2*t2 + t))
+            + x1*(3*t2 - 2*t3)
+            + k[6]*(h*(t3 - t2))
+        );
+    }
+    res.ahead.push_back(x1);
+
+    if (dot_product(k[6], k[6]) < 0.01) {
+        res.slope.reset(); // ran into a degenerate point, sample afresh
+    } else {
+        res.slope = k[6];
+    }
+    res.step = h_next;
+}
+
+
+// one accepted step along the unit eigenvectors with the step size under
+// error control, its points queued in res.ahead
+bool RoadGenerator::step_dormand_prince(Integration& res, size_t road,
+    const Eigenfield& ef) const
+{
+    const GeneratorParameters& param = params_[road];
+
+    RVector2 x = res.integration_front;
+    std::array<RVector2, 7> k;
+
+    if (res.slope.has_value()) {
+        k[0] = res.slope.value();
+    } else {
+        k[0] = get_eigenvector(x, ef);
+        if (res.negate) k[0] = k[0]*-1.0;
+    }
+
+    if (dot_product(k[0], k[0]) < 0.01) return false;
+
+    real h = res.step > 0 ? res.step : std::min(param.node_sep, param.d_test/2);
+    real h_next;
+
+    do {
+        for (int s=1; s<7; ++s) {
+            RVector2 xs = x;
+            for (int j=0; j<s; ++j) xs = xs + k[j]*(h*kDopriA[s][j]);
+
+            // eigenvectors have no sign, keep every stage heading the same way
+            k[s] = get_eigenvector(xs, ef);
+            if (dot_product(k[s], k[0]) < 0) k[s] = k[s]*-1.0;
+        }
+    } while (!accept_dormand_prince(road, k, h, h_next));
+
+    emit_dormand_prince(res, road, x, k, h, h_next);
+    return true;
+}
+
+
+// the same step for many fronts at once, each stage sampled for all of
+// them in one batch. fronts that cannot step are aborted.
+void RoadGenerator::step_dormand_prince(std::vector<DopriFront>& fronts,
+    size_t road, Wavefront& w) const
+{
+    const GeneratorParameters& param = params_[road];
+
+    w.clear();
+    for (DopriFront& f : fronts) {
+        if (f.res->slope.has_value()) continue;
+
+        w.begin_front(f.x);
+        w.push(f.x);
+    }
+
+    if (w.size() > 0) sample_eigenvectors(w);
+
+    size_t fresh = 0;
+    for (DopriFront& f : fronts) {
+        if (f.res->slope.has_value()) {
+            f.k[0] = f.res->slope.value();
+        } else {
+            RVector2 k = w.eigenvector(fresh++, f.ef);
+            f.k[0] = f.res->negate ? k*-1.0 : k;
+        }
+
+        f.h = f.res->step > 0 ? f.res->step : std::min(param.node_sep, param.d_test/2);
+    }
+
+    std::erase_if(fronts, [](DopriFront& f) {
+        if (dot_product(f.k[0], f.k[0]) >= 0.01) return false;
+        f.res->status = Abort;
+        return true;
+    });
+
+    // rejected steps are retried smaller with the others still pending
+    while (!fronts.empty()) {
+        for (int s=1; s<7; ++s) {
+            w.clear();
+            for (const DopriFront& f : fronts) {
+                w.begin_front(f.x);
+
+                RVector2 xs = f.x;
+                for (int j=0; j<s; ++j) xs = xs + f.k[j]*(f.h*kDopriA[s][j]);
+                w.push(xs);
+            }
+
+            sample_eigenvectors(w);
+
+            for (size_t i=0; i<fronts.size(); ++i) {
+                RVector2 k = w.eigenvector(i, fronts[i].ef);
+                fronts[i].k[s] = dot_product(k, fronts[i].k[0]) < 0 ? k*-1.0 : k;
+            }
+        }
+
+        std::erase_if(fronts, [&](DopriFront& f) {
+            real h_next;
+            if (!accept_dormand_prince(road, f.k, f.h, h_next)) return false;
+
+            emit_dormand_prince(*f.res, road, f.x, f.k, f.h, h_next);
+            return true;
+        });
+    }
+}
+
+
+// stops the front at the bounds, near other roads and degenerate points
+void RoadGenerator::check_front(
     Integration& res,
-    const size_t& road, 
-    const Eigenfield& ef 
+    const size_t& road,
+    const Eigenfield& ef
 ) const {
-    if (res.status != Continue) {
+    if (!in_bounds(res.integration_front)) {
         res.status = Abort;
         return;
-    };
+    }
 
-    DVector2 delta = integrate_rk4(
-        res.integration_front, 
-        ef, 
-        params_[road].dl
-    );
+    res.status = Continue;
 
+    const real& d_test = params_[road].d_test;
+    bool blocked = false;
+
+    if (res.ahead_clear) {
+        // the whole step was tested in take_ahead
+    } else if (swept_collision_ && res.delta.has_value()) {
+        blocked = has_nearby_segment(res.integration_front - res.delta.value(),
+            res.integration_front, d_test, ef);
+    } else {
+        blocked = has_nearby_point(res.integration_front, d_test, ef);
+    }
+
+    if (blocked) res.status = Terminate;
+
+    // streamlines only circle a degenerate point, stop before spiralling in
+    if (degenerate_.near(res.integration_front, params_[road].d_test)) {
+        res.status = Terminate;
+    }
+}
+
+
+// moves the front by an rk4 increment, kept heading the same way
+void RoadGenerator::apply_rk4(
+    Integration& res,
+    const size_t& road,
+    const Eigenfield& ef,
+    RVector2 delta
+) const {
     if (res.negate) 
         delta = delta*-1.0;
 
@@ -128,91 +548,263 @@ void RoadGenerator::extend_road(
         return;
     }
 
+    count(steps_taken_, 1);
+
     res.integration_front = res.integration_front + delta;
     res.delta = delta;
-    if (!in_bounds(res.integration_front)) {
+
+    check_front(res, road, ef);
+}
+
+
+// moves the front to the next point of its last adaptive step
+void RoadGenerator::take_ahead(
+    Integration& res,
+    const size_t& road,
+    const Eigenfield& ef
+) const {
+    // one swept test for a whole step, widened by how far its points bend
+    // off the chord, spares the test per point when no road is near
+    if (swept_collision_ && res.next_ahead == 0) {
+        const RVector2& x0 = res.integration_front;
+        const RVector2& x1 = res.ahead.back();
+
+        real bend = 0;
+        for (const RVector2& p : res.ahead)
+            bend = std::max(bend, segment_distance(p, x0, x1));
+
+        res.ahead_clear = !has_nearby_segment(x0, x1, params_[road].d_test + bend, ef);
+    }
+
+    const RVector2& next = res.ahead[res.next_ahead++];
+
+    res.delta = next - res.integration_front;
+    res.integration_front = next;
+
+    check_front(res, road, ef);
+}
+
+
+void RoadGenerator::extend_road(
+    Integration& res,
+    const size_t& road, 
+    const Eigenfield& ef 
+) const {
+    if (res.status != Continue) {
         res.status = Abort;
         return;
-    }
+    };
 
-    res.status = Continue;
-    if (has_nearby_point(res.integration_front, params_[road].d_test, ef)) {
-        res.status = Terminate;
+    if (integrator_ == DormandPrince) {
+        if (!res.has_ahead() && !step_dormand_prince(res, road, ef)) {
+            res.status = Abort;
+            return;
+        }
+
+        take_ahead(res, road, ef);
+    } else {
+        apply_rk4(res, road, ef,
+            integrate_rk4(res.integration_front, ef, params_[road].dl));
     }
 }
 
 
-std::list<DVector2>
-RoadGenerator::spawn_road(size_t road, DVector2 seed_point, Eigenfield ef) {
-    Integration forward  (seed_point, false);
-    Integration backward (seed_point, true );
+RoadGenerator::Spawn::Spawn(RVector2 seed, Eigenfield ef) :
+    forward(seed, false),
+    backward(seed, true),
+    ef(ef)
+{}
 
-    // circle logic
-    bool points_diverged = false;
-    bool join = false; // flag to join endpoints (in a circular road)
 
-    int count = 0;
+// takes p, the next point traced by res, simplifying as it goes: points
+// are dropped while a chord from the last kept point passes within epsilon
+// of all of them, and the first one node_sep from it is kept, as the
+// douglas-peucker base case would. the dropped points narrow a cone of
+// directions such a chord may take, and when p falls outside it the point
+// before p is kept instead. only kept points are ever stored.
+void RoadGenerator::trace_point(Integration& res, size_t road, RVector2 p) const {
+    const GeneratorParameters& param = params_[road];
+    assert(param.epsilon > 0.0);
 
-    const auto& max_iter = params_[road].max_integration_iterations;
+    res.before_tip = res.tip;
+    res.tip = p;
+    res.traced++;
 
-    while(count<max_iter) {
-        extend_road(forward,  road, ef);
-        extend_road(backward, road, ef);
+    if (res.pending.has_value()) {
+        RVector2 d = p - res.points.back();
 
-        if (backward.status == Abort && forward.status == Abort)
-            break;
+        bool in_cone = !res.cone_set || (
+            cross_product(res.cone_right, d) >= 0
+            && cross_product(d, res.cone_left) >= 0
+            && dot_product(d, res.cone_right + res.cone_left) > 0);
 
-        if (forward.status != Abort) {
-            forward.points.push_back(forward.integration_front);
-            count++;
+        if (res.cone_closed || !in_cone) {
+            res.points.push_back(res.pending.value());
+            res.pending.reset();
+            res.cone_set = false;
+            res.cone_closed = false;
         }
+    }
 
-        if (backward.status != Abort) {
-            backward.points.push_front(backward.integration_front);
-            count++;
-        }
+    RVector2 d = p - res.points.back();
+    real d2 = dot_product(d, d);
 
+    if (d2 >= param.node_sep2) {
+        res.points.push_back(p);
+        res.pending.reset();
+        res.cone_set = false;
+        res.cone_closed = false;
+        return;
+    }
 
-        DVector2 ends_diff = forward.points.back() - backward.points.front();
-        double sep2 = dot_product(ends_diff, ends_diff);
+    res.pending = p;
 
-        if (points_diverged && sep2 < params_[road].d_circle2) {
-            join = true;
-            break;
-        } else if (!points_diverged && sep2 > params_[road].d_circle2) {
-            points_diverged = true;
-        }
+    // any chord passes within epsilon of a point this close
+    real eps2 = param.epsilon*param.epsilon;
+    if (d2 <= eps2) return;
+
+    // the directions within epsilon of p, turned by asin(epsilon/|d|)
+    real dist = std::sqrt(d2);
+    RVector2 u = d/dist;
+    real sin_a = param.epsilon/dist;
+    real cos_a = std::sqrt(1.0 - eps2/d2);
+
+    RVector2 right = {u.x*cos_a + u.y*sin_a, u.y*cos_a - u.x*sin_a};
+    RVector2 left  = {u.x*cos_a - u.y*sin_a, u.y*cos_a + u.x*sin_a};
+
+    if (!res.cone_set) {
+        res.cone_right = right;
+        res.cone_left = left;
+        res.cone_set = true;
+        return;
+    }
+
+    // a point behind the cone, around a hairpin, leaves no chord
+    if (dot_product(u, res.cone_right + res.cone_left) <= 0) {
+        res.cone_closed = true;
+        return;
+    }
+
+    if (cross_product(res.cone_right, right) > 0) res.cone_right = right;
+    if (cross_product(left, res.cone_left) > 0) res.cone_left = left;
+}
+
+
+// keeps the last point traced by res, the ends are always kept
+void RoadGenerator::flush_points(Integration& res) const {
+    if (res.pending.has_value()) {
+        res.points.push_back(res.pending.value());
+        res.pending.reset();
+    }
+}
+
+
+// takes the points both ends of s have just reached. false once the
+// streamline is done: both ends aborted or they met around a loop.
+bool RoadGenerator::record_step(Spawn& s, size_t road) const {
+    Integration& forward = s.forward;
+    Integration& backward = s.backward;
+
+    if (backward.status == Abort && forward.status == Abort)
+        return false;
+
+    if (forward.status != Abort) {
+        trace_point(forward, road, forward.integration_front);
+        s.count++;
+    }
+
+    if (backward.status != Abort) {
+        trace_point(backward, road, backward.integration_front);
+        s.count++;
     }
 
-    backward.points.pop_back(); // remove shared start point
 
-    if (join) {
-        forward.points.push_back(backward.points.back()); // join up streamlines
+    RVector2 ends_diff = forward.tip - backward.tip;
+    real sep2 = dot_product(ends_diff, ends_diff);
+
+    // adaptive or swept points can be further apart than d_circle, so
+    // the ends could pass each other between checks
+    if ((integrator_ == DormandPrince || swept_collision_)
+        && forward.traced > 1 && backward.traced > 1) {
+        real d = segments_distance(
+            forward.before_tip, forward.tip,
+            backward.before_tip, backward.tip
+        );
+        sep2 = d*d;
+    }
+
+    if (s.diverged && sep2 < params_[road].d_circle2) {
+        s.join = true;
+        return false;
+    } else if (!s.diverged && sep2 > params_[road].d_circle2) {
+        s.diverged = true;
     }
 
-    std::list<DVector2> result;
+    return true;
+}
+
+
+// the streamline of s into out, the backward half reversed in front of
+// the forward half. they share the seed.
+void RoadGenerator::finish_spawn(Spawn& s, std::vector<RVector2>& out) const {
+    count(streamlines_traced_, 1);
+
+    flush_points(s.backward);
+    flush_points(s.forward);
 
-    result.splice(result.end(), backward.points);
-    result.splice(result.end(), forward.points);
+    const std::vector<RVector2>& backward = s.backward.points;
+    const std::vector<RVector2>& forward = s.forward.points;
 
-    return result;
+    out.clear();
+    out.reserve(backward.size() + forward.size());
+
+    out.insert(out.end(), backward.rbegin(), std::prev(backward.rend()));
+    out.insert(out.end(), forward.begin(), forward.end());
+
+    // the ends met, close the loop at the backward tip
+    if (s.join && backward.size() > 1) {
+        out.push_back(out.front());
+    }
+}
+
+
+void RoadGenerator::spawn_road(size_t road, RVector2 seed_point, Eigenfield ef,
+    std::vector<RVector2>& out) const
+{
+    Spawn s(seed_point, ef);
+
+    const auto& max_iter = params_[road].max_integration_iterations;
+
+    while (s.count < max_iter) {
+        extend_road(s.forward,  road, ef);
+        extend_road(s.backward, road, ef);
+
+        if (!record_step(s, road)) break;
+    }
+
+    finish_spawn(s, out);
 }
 
 
 int RoadGenerator::generate_roads(size_t road_type) {
+    reset_coverage(road_type);
+
+    if (trace_threads_ > 1 || lockstep_seeds_ > 0)
+        return generate_roads_parallel(road_type);
+
     Eigenfield ef = Eigenfield::major();
 
-    std::optional<DVector2> seed = get_seed(road_type, ef);
+    std::vector<RVector2> streamline; // reused by every seed
+
+    std::optional<RVector2> seed = get_seed(road_type, ef);
     int k = 0;
     while (seed.has_value()) {
         std::cout << "Seed: " << seed.value() << std::endl;
-        std::list<DVector2> streamline = spawn_road(road_type, seed.value(), ef);
-
-        simplify_streamline(road_type, streamline);
-
+        spawn_road(road_type, seed.value(), ef, streamline);
 
         if (streamline.size() >= tangent_samples_) { 
             push_road(streamline, road_type, ef);
+            count(streamlines_committed_, 1);
             k += 1;
 
             ef = ef.opposite();
@@ -221,77 +813,726 @@ int RoadGenerator::generate_roads(size_t road_type) {
         seed = get_seed(road_type, ef);
     };
 
+    return k;
+}
+
+
+RoadGenerator::BatchCommits::BatchCommits(real cell_size) :
+    cell_size(cell_size)
+{}
+
+
+static std::uint64_t commit_key(int cx, int cy) {
+    return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(cx)) << 32)
+        | static_cast<std::uint32_t>(cy);
+}
+
+
+void RoadGenerator::BatchCommits::add(std::span<const RVector2> points,
+    Eigenfield ef)
+{
+    for (size_t i=0; i<points.size(); ++i) {
+        const RVector2& p = points[i];
+        int cx = static_cast<int>(std::floor(p.x/cell_size));
+        int cy = static_cast<int>(std::floor(p.y/cell_size));
+        cells[ef][commit_key(cx, cy)].push_back(p);
+
+        if (i > 0) {
+            RVector2 d = p - points[i-1];
+            longest = std::max(longest, std::sqrt(dot_product(d, d)));
+        }
+    }
+}
+
+
+bool RoadGenerator::BatchCommits::near(const RVector2& pos, real radius,
+    Eigenfield ef) const
+{
+    const auto& grid = cells[ef];
+    if (grid.empty()) return false;
+
+    int cx = static_cast<int>(std::floor(pos.x/cell_size));
+    int cy = static_cast<int>(std::floor(pos.y/cell_size));
+    real radius2 = radius*radius;
+
+    // more rings of cells for a radius past the cell size
+    int reach = std::max(1, static_cast<int>(std::ceil(radius/cell_size)));
+
+    for (int dx=-reach; dx<=reach; ++dx) {
+        for (int dy=-reach; dy<=reach; ++dy) {
+            auto it = grid.find(commit_key(cx+dx, cy+dy));
+            if (it == grid.end()) continue;
+
+            for (const RVector2& p : it->second) {
+                RVector2 diff = p - pos;
+                if (dot_product(diff, diff) < radius2) return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+
+// traces the seeds of traces together: each round advances both ends of
+// every unfinished streamline by one point, sampling the field for all
+// of them in one batch per integration stage. finished streamlines are
+// compacted out, so the batches only ever hold live fronts.
+void RoadGenerator::trace_lockstep(size_t road, std::vector<Trace*>& traces) const {
+    const GeneratorParameters& param = params_[road];
+
+    std::vector<Spawn> spawns;
+    spawns.reserve(traces.size());
+    for (const Trace* t : traces) spawns.emplace_back(t->seed, t->ef);
+
+    std::vector<size_t> live(traces.size());
+    std::iota(live.begin(), live.end(), 0);
+
+    Wavefront w;
+    std::vector<std::pair<Integration*, Eigenfield>> stepping;
+    std::vector<DopriFront> dopri;
+
+    while (!live.empty()) {
+        // fronts that stopped last round abort now, as in extend_road
+        stepping.clear();
+        for (size_t i : live) {
+            for (Integration* res : {&spawns[i].forward, &spawns[i].backward}) {
+                if (res->status != Continue) {
+                    res->status = Abort;
+                } else {
+                    stepping.push_back({res, spawns[i].ef});
+                }
+            }
+        }
+
+        // nearby fronts next to each other, so they share batched samples
+        std::stable_sort(stepping.begin(), stepping.end(),
+            [](const auto& l, const auto& r) {
+                return Wavefront::cell_of(l.first->integration_front)
+                    < Wavefront::cell_of(r.first->integration_front);
+            });
+
+        if (integrator_ == DormandPrince) {
+            dopri.clear();
+            for (auto [res, ef] : stepping) {
+                if (!res->has_ahead()) dopri.push_back({res, ef, res->integration_front, {}, 0});
+            }
+
+            if (!dopri.empty()) step_dormand_prince(dopri, road, w);
+
+            for (auto [res, ef] : stepping) {
+                if (res->status != Abort) take_ahead(*res, road, ef);
+            }
+        } else {
+            // the stage positions of integrate_rk4, three per front
+            RVector2 dx = {param.dl, param.dl};
+
+            w.clear();
+            for (auto [res, ef] : stepping) {
+                RVector2 x = res->integration_front;
+                w.begin_front(x);
+                w.push(x);
+                w.push(x + dx/2.0);
+                w.push(x + dx);
+            }
+
+            if (w.size() > 0) sample_eigenvectors(w);
+
+            for (size_t i=0; i<stepping.size(); ++i) {
+                auto [res, ef] = stepping[i];
+                RVector2 k1 = w.eigenvector(3*i, ef);
+                RVector2 k2 = w.eigenvector(3*i + 1, ef);
+                RVector2 k4 = w.eigenvector(3*i + 2, ef);
+
+                apply_rk4(*res, road, ef, k1 + k2*4.0 + k4/6.0);
+            }
+        }
+
+        std::erase_if(live, [&](size_t i) {
+            Spawn& s = spawns[i];
+            if (record_step(s, road) && s.count < param.max_integration_iterations)
+                return false;
+
+            Trace& t = *traces[i];
+            finish_spawn(s, t.points);
+            return true;
+        });
+    }
+}
+
+
+// job(index, stride) on up to count threads of the pool, the calling
+// thread as index 0. without a pool the caller runs it alone.
+void RoadGenerator::run_parallel(size_t count,
+    const std::function<void(size_t index, size_t stride)>& job) const
+{
+    size_t threads = pool_ ? std::min(count, pool_->size()) : 1;
+
+    if (threads <= 1) {
+        job(0, 1);
+        return;
+    }
+
+    pool_->run(threads, [&](size_t index) { job(index, threads); });
+}
+
+
+// traces every seed of the batch against the storage as it stands. nothing
+// is inserted meanwhile, so the workers only ever read shared state.
+void RoadGenerator::trace_batch(size_t road, std::vector<Trace>& batch) const {
+    auto work = [this, road, &batch](size_t first, size_t stride) {
+        if (lockstep_seeds_ > 0) {
+            std::vector<Trace*> traces;
+            for (size_t i=first; i<batch.size(); i+=stride) traces.push_back(&batch[i]);
+
+            trace_lockstep(road, traces);
+            return;
+        }
+
+        for (size_t i=first; i<batch.size(); i+=stride) {
+            Trace& t = batch[i];
+            spawn_road(road, t.seed, t.ef, t.points);
+        }
+    };
+
+    run_parallel(batch.size(), work);
+}
+
+
+// speculative variant of generate_roads: a batch of seeds is traced in
+// parallel against the storage before any of them is inserted, then
+// committed in seed order. a streamline that a road committed earlier in
+// the same batch would have stopped goes back to the candidates and is
+// traced in a later batch, and a seed such a road now crowds is dropped,
+// as the serial loop would. the seeds alternate eigenfields as they are
+// drawn, where the serial loop only switches after a commit.
+int RoadGenerator::generate_roads_parallel(size_t road_type) {
+    const GeneratorParameters& param = params_[road_type];
+    // not scaled by the thread count, which only splits the batch, so
+    // the roads come out the same with any number of threads
+    size_t batch_size = lockstep_seeds_ > 0 ? lockstep_seeds_ : kSeedsPerBatch;
+
+    Eigenfield ef = Eigenfield::major();
+    int k = 0;
+
+    std::vector<Trace> batch;
+    std::vector<std::pair<RVector2, Eigenfield>> deferred;
+    std::vector<RVector2> serial; // verify_speculation_ only
+
+    while (true) {
+        batch.clear();
+        deferred.clear();
+
+        for (size_t attempt=0; attempt<batch_size; ++attempt) {
+            std::optional<RVector2> seed = get_seed(road_type, ef);
+            if (!seed.has_value()) break;
+
+            // two seeds this close would only have one survive the commit,
+            // so trace the second in a later batch instead
+            bool crowded = std::any_of(batch.begin(), batch.end(),
+                [&](const Trace& t) {
+                    RVector2 diff = t.seed - seed.value();
+                    return t.ef == ef && dot_product(diff, diff) < param.d_sep2;
+                });
+
+            if (crowded) {
+                deferred.push_back({seed.value(), ef});
+                continue;
+            }
+
+            batch.push_back({seed.value(), ef, {}});
+            ef = ef.opposite();
+        }
+
+        if (batch.empty()) break;
+
+        trace_batch(road_type, batch);
 
-    // connect_roads(road_type, Major);
-    // connect_roads(road_type, Minor);
+        // a point dropped by the simplification lies within node_sep of the
+        // point kept before it, so the kept points are checked that much wider
+        real stale_radius = param.d_test + param.node_sep;
+        BatchCommits commits(std::max(param.d_sep, stale_radius));
+
+        for (Trace& t : batch) {
+            if (commits.near(t.seed, param.d_sep, t.ef)) continue;
+
+            real radius = stale_radius;
+
+            // a swept front stops at a segment. the raw steps stay within
+            // epsilon of the kept ones, and the closest points of two
+            // segments are within half their length of an end of each.
+            if (swept_collision_) {
+                real longest = 0;
+                for (size_t i=1; i<t.points.size(); ++i) {
+                    RVector2 d = t.points[i] - t.points[i-1];
+                    longest = std::max(longest, std::sqrt(dot_product(d, d)));
+                }
+
+                radius = std::max(radius,
+                    param.d_test + param.epsilon + (longest + commits.longest)/2);
+            }
+
+            bool stale = std::any_of(t.points.begin(), t.points.end(),
+                [&](const RVector2& p) {
+                    return commits.near(p, radius, t.ef);
+                });
+
+            // traced again with the next batch rather than here, alone
+            if (stale) {
+                deferred.push_back({t.seed, t.ef});
+                continue;
+            }
+
+            if (verify_speculation_) {
+                spawn_road(road_type, t.seed, t.ef, serial);
+                if (serial != t.points) count(streamlines_mispredicted_, 1);
+            }
+
+            if (t.points.size() < static_cast<size_t>(tangent_samples_)) continue;
+
+            commits.add(t.points, t.ef);
+            push_road(t.points, road_type, t.ef);
+            count(streamlines_committed_, 1);
+            k += 1;
+        }
+
+        for (const auto& [seed, seed_ef] : deferred) {
+            add_candidate_seed(seed, seed_ef, road_type);
+        }
+    }
 
     return k;
 }
 
 
-void RoadGenerator::simplify_streamline(size_t road, std::list<DVector2>& points) const {
-    assert(params_[road].epsilon > 0.0);
-    douglas_peucker(params_[road].epsilon, params_[road].node_sep2, points, points.begin(), points.end());
+// parameter range [t0, t1] of the segment p->q inside box, Liang-Barsky
+static bool clip_segment(const RVector2& p, const RVector2& q,
+    const Box<real>& box, real& t0, real& t1)
+{
+    RVector2 d = q - p;
+    real dp[4] = {-d.x, d.x, -d.y, d.y};
+    real dq[4] = {p.x - box.min.x, box.max.x - p.x, p.y - box.min.y, box.max.y - p.y};
+
+    t0 = 0;
+    t1 = 1;
+
+    for (int i=0; i<4; ++i) {
+        if (dp[i] == 0) {
+            if (dq[i] < 0) return false;
+            continue;
+        }
+
+        real t = dq[i]/dp[i];
+        if (dp[i] < 0) t0 = std::max(t0, t);
+        else           t1 = std::min(t1, t);
+    }
+
+    return t0 < t1;
 }
 
 
-void RoadGenerator::douglas_peucker(const double& epsilon, const double& min_sep2, 
-        std::list<DVector2>& points,
-        std::list<DVector2>::iterator begin, std::list<DVector2>::iterator end) const 
+// generates one tile on a generator of its own, over the core and a halo
+// of each road type's d_sep so roads near the seams see what they would
+// have to avoid, then keeps only what lies in the core. the halo is
+// regenerated by the neighbours, so dropping it there drops the duplicates.
+// the field, obstacles and boxes are moved to origin first.
+std::vector<RoadGenerator::TilePiece>
+RoadGenerator::generate_tile(const TensorField* field, const Box<real>& world_core,
+    const Box<real>& world_limit, std::uint64_t seed, const RVector2& origin) const
 {
-    // must be 3> elements 
-    int count = 0;
-    for (auto it=begin;it!=end && count < 3;++it, ++count);
-    if (count < 3) return;
+    std::optional<TensorField> moved;
+    if (!(origin == RVector2{0, 0})) {
+        moved.emplace(*field);
+        moved->move_origin(origin);
+        field = &moved.value();
+    }
+
+    Box<real> core(world_core.min - origin, world_core.max - origin);
+    Box<real> limit(world_limit.min - origin, world_limit.max - origin);
+
+    real halo = 0;
+    for (size_t i=0; i<road_type_count_; ++i) halo = std::max(halo, params_[i].d_sep);
+
+    RVector2 halo_diag = {halo, halo};
+    Box<real> bounds = Box<real>(core.min - halo_diag, core.max + halo_diag) & limit;
+
+    RoadGenerator gen(field, road_type_count_, params_, bounds);
+    gen.core_ = core;
+    gen.integrator_ = integrator_;
+    gen.lockstep_seeds_ = lockstep_seeds_;
+    gen.seed_order_ = seed_order_;
+    gen.join_roads_ = false; // seams would cut the joins, see generate_tiled
+    gen.swept_collision_ = swept_collision_;
+    gen.tile_key_ = seed;
+
+    // tiles are generated in parallel already, see generate_tiled and
+    // ChunkWorld, so each bakes its own raster on the thread it runs on
+    if (use_raster_) {
+        gen.enable_field_raster(raster_.get_cell_size());
+        gen.raster_.set_bake_threads(1);
+    }
+
+    for (size_t i=0; i<obstacles_.size(); ++i) {
+        std::vector<RVector2> polygon = obstacles_.get_polygon(i);
+        for (RVector2& p : polygon) p = p - origin;
+
+        gen.add_obstacle(std::move(polygon));
+    }
+
+    gen.generate();
+
+    std::vector<TilePiece> pieces;
+
+    for (size_t road=0; road<road_type_count_; ++road) {
+        for (Eigenfield ef : {Eigenfield::major(), Eigenfield::minor()}) {
+            RoadHandle handle {0, road, ef};
+
+            for (std::uint32_t idx=0; idx<gen.road_count(road, ef); ++idx) {
+                handle.idx = idx;
+                const Road& r = gen.get_road(handle);
+
+                std::vector<RVector2> piece;
+                bool open_front = false;
+                size_t first = pieces.size();
+
+                auto flush = [&](bool open_back) {
+                    if (piece.size() >= 2) {
+                        pieces.push_back({std::move(piece), road, ef, 0,
+                            {open_front, open_back}});
+                    }
+                    piece.clear();
+                };
+
+                for (std::uint32_t i=r.begin; i+1<r.end; ++i) {
+                    const RVector2& p = gen.get_pos({i, handle});
+                    const RVector2& q = gen.get_pos({i+1, handle});
+
+                    real t0, t1;
+                    if (!clip_segment(p, q, core, t0, t1)) {
+                        if (!piece.empty()) flush(true);
+                        continue;
+                    }
+
+                    RVector2 d = q - p;
+
+                    if (!piece.empty() && t0 > 0) flush(true);
+                    if (piece.empty()) {
+                        open_front = t0 > 0;
+                        piece.push_back(p + d*t0);
+                    }
+
+                    piece.push_back(p + d*t1);
+                    if (t1 < 1) flush(true);
+                }
+
+                flush(false);
+
+                // a loop that leaves the core is cut where it closes as well,
+                // its last piece runs on into its first
+                bool loop = gen.get_pos({r.begin, handle}) == gen.get_pos({r.end-1, handle});
+                if (loop && pieces.size() > first+1
+                    && !pieces[first].open[0] && !pieces.back().open[1])
+                {
+                    TilePiece& head = pieces[first];
+                    TilePiece& tail = pieces.back();
+
+                    tail.points.insert(tail.points.end(),
+                        head.points.begin()+1, head.points.end());
+                    tail.open[1] = head.open[1];
+
+                    head = std::move(tail);
+                    pieces.pop_back();
+                }
+
+                if (pieces.size() > first+1) {
+                    for (size_t i=first; i<pieces.size(); ++i) pieces[i].split = true;
+                }
+            }
+        }
+    }
 
-    auto last_elem = std::prev(end);
+    return pieces;
+}
+
+
+// ends of the same road type and eigenfield are paired closest first when
+// they are within d_test and leave their pieces towards each other
+RoadGenerator::TileLinks
+RoadGenerator::pair_tile_ends(const std::vector<TilePiece>& pieces) const {
+    struct Candidate {
+        real dist2;
+        TileEnd a;
+        TileEnd b;
+    };
+
+    real cell_size = 0;
+    for (size_t i=0; i<road_type_count_; ++i) {
+        cell_size = std::max(cell_size, params_[i].d_test);
+    }
+
+    auto end_pos = [&](const TileEnd& e) -> const RVector2& {
+        const std::vector<RVector2>& pts = pieces[e.piece].points;
+        return e.side == 0 ? pts.front() : pts.back();
+    };
 
-    const DVector2& first_pos = *begin;
-    const DVector2& last_pos  = *last_elem;
+    auto end_dir = [&](const TileEnd& e) {
+        const std::vector<RVector2>& pts = pieces[e.piece].points;
+        return e.side == 0
+            ? pts.front() - pts[1]
+            : pts.back() - pts.end()[-2];
+    };
 
-    double d_max = 0.0;
-    std::list<DVector2>::iterator index;
+    auto cell = [&](const RVector2& p) {
+        return std::pair {
+            static_cast<int>(std::floor(p.x/cell_size)),
+            static_cast<int>(std::floor(p.y/cell_size))
+        };
+    };
 
+    std::unordered_map<std::uint64_t, std::vector<TileEnd>> grid;
 
-    for (auto it=std::next(begin); it != last_elem; ++it) {
-        double d = perpendicular_distance(*it, first_pos, last_pos);
+    for (size_t i=0; i<pieces.size(); ++i) {
+        for (int side=0; side<2; ++side) {
+            if (!pieces[i].open[side]) continue;
 
-        if (d > d_max) {
-            d_max = d;
-            index = it;
+            auto [cx, cy] = cell(end_pos({i, side}));
+            grid[commit_key(cx, cy)].push_back({i, side});
         }
     }
 
-    if (d_max > epsilon) {
-        douglas_peucker(epsilon, min_sep2, points, begin, std::next(index));
-        douglas_peucker(epsilon, min_sep2, points, index, end);
-    } else {
-        for (auto it=std::next(begin); it!=std::prev(end);) {
-            auto next = std::next(it);
+    std::vector<Candidate> candidates;
+
+    for (const auto& [key, ends] : grid) {
+        for (const TileEnd& a : ends) {
+            const TilePiece& pa = pieces[a.piece];
+            real d_test = params_[pa.road_type].d_test;
+            auto [cx, cy] = cell(end_pos(a));
+
+            for (int dx=-1; dx<=1; ++dx) {
+                for (int dy=-1; dy<=1; ++dy) {
+                    auto it = grid.find(commit_key(cx+dx, cy+dy));
+                    if (it == grid.end()) continue;
+
+                    for (const TileEnd& b : it->second) {
+                        const TilePiece& pb = pieces[b.piece];
+
+                        if (b.piece <= a.piece || pb.tile == pa.tile
+                            || pb.road_type != pa.road_type || pb.ef != pa.ef)
+                            continue;
+
+                        RVector2 diff = end_pos(b) - end_pos(a);
+                        real dist2 = dot_product(diff, diff);
+
+                        if (dist2 > d_test*d_test) continue;
+                        if (dot_product(end_dir(a), end_dir(b)) >= 0) continue;
+
+                        candidates.push_back({dist2, a, b});
+                    }
+                }
+            }
+        }
+    }
+
+    std::sort(candidates.begin(), candidates.end(),
+        [](const Candidate& x, const Candidate& y) { return x.dist2 < y.dist2; });
+
+    TileLinks links(pieces.size());
+
+    for (const Candidate& c : candidates) {
+        auto& la = links[c.a.piece][c.a.side];
+        auto& lb = links[c.b.piece][c.b.side];
+        if (la.has_value() || lb.has_value()) continue;
+
+        la = c.b;
+        lb = c.a;
+    }
+
+    return links;
+}
+
+
+// inserts the pieces of every tile, chaining open ends across the seams
+void RoadGenerator::stitch_tiles(std::vector<TilePiece>& pieces) {
+    TileLinks links = pair_tile_ends(pieces);
+
+    struct Chain {
+        std::vector<RVector2> points;
+        size_t road_type;
+        Eigenfield ef;
+        bool split;
+    };
+
+    std::vector<Chain> chains;
+    std::vector<bool> used(pieces.size(), false);
+
+    auto walk = [&](size_t first, int entry) {
+        Chain chain {{}, pieces[first].road_type, pieces[first].ef, false};
+        size_t i = first;
+        int side = entry;
+
+        while (true) {
+            used[i] = true;
+            chain.split = chain.split || pieces[i].split;
+
+            std::vector<RVector2>& pts = pieces[i].points;
+            if (side == 1) {
+                chain.points.insert(chain.points.end(), pts.rbegin(), pts.rend());
+            } else {
+                chain.points.insert(chain.points.end(), pts.begin(), pts.end());
+            }
+            pts = {};
+
+            std::optional<TileEnd> next = links[i][1-side];
+            if (!next.has_value()) break;
+
+            if (used[next->piece]) {
+                if (next->piece == first) chain.points.push_back(chain.points.front()); // loop
+                break;
+            }
+
+            i = next->piece;
+            side = next->side;
+        }
+
+        chains.push_back(std::move(chain));
+    };
+
+    // chains start at an end that was not stitched, what is left are loops
+    for (size_t i=0; i<pieces.size(); ++i) {
+        if (used[i]) continue;
+
+        if (!links[i][0].has_value()) walk(i, 0);
+        else if (!links[i][1].has_value()) walk(i, 1);
+    }
+
+    for (size_t i=0; i<pieces.size(); ++i) {
+        if (!used[i]) walk(i, 0);
+    }
 
-            auto prev = std::prev(it);
-            DVector2 diff = *it - *prev;
-            double dist2 = dot_product(diff, diff);
+    std::stable_sort(chains.begin(), chains.end(),
+        [](const Chain& x, const Chain& y) { return x.road_type < y.road_type; });
 
-            if (dist2 < min_sep2) points.erase(it);
+    // roads of different tiles only saw each other through the halos. where
+    // they still come within d_test of what is already stored they are cut
+    // as the serial tracer would have stopped them, and short leftovers are
+    // dropped.
+    RVector2 tile_size = {
+        viewport_.width()/tiles_x_,
+        viewport_.height()/tiles_y_
+    };
+
+    // a tile's own roads are already apart, only points this close to a
+    // seam can meet those of another tile
+    auto near_seam = [&](const RVector2& p, real d) {
+        auto seam_distance = [](real v, real size, int count) {
+            real k = std::clamp(std::round(v/size), real(1), real(count-1));
+            return std::abs(v - k*size);
+        };
+
+        return (tiles_x_ > 1 && seam_distance(p.x - viewport_.min.x, tile_size.x, tiles_x_) <= d)
+            || (tiles_y_ > 1 && seam_distance(p.y - viewport_.min.y, tile_size.y, tiles_y_) <= d);
+    };
+
+    for (const Chain& chain : chains) {
+        real d_test = params_[chain.road_type].d_test;
+
+        const std::vector<RVector2>& pts = chain.points;
+
+        // tested as the sweep reaches them, so once a chain is cut the
+        // rest of it keeps apart from the part already inserted as well.
+        // a road the clip split may come back beside itself anywhere.
+        bool cut = chain.split;
+        auto blocked = [&](size_t k) {
+            return (cut || near_seam(pts[k], d_test))
+                && has_nearby_point(pts[k], d_test, chain.ef);
+        };
+
+        // a cut at a seam can land much closer than a serial stop
+        auto keep_stop = [&](size_t k) {
+            return !has_nearby_point(pts[k], d_test/2, chain.ef);
+        };
+
+        size_t i = 0;
+        while (i < pts.size()) {
+            while (i < pts.size() && blocked(i)) ++i;
+            if (i == pts.size()) break;
 
-            it = next;
+            size_t begin = i > 0 && keep_stop(i-1) ? i-1 : i;
+            while (i < pts.size() && !blocked(i)) ++i;
+            size_t end = i < pts.size() && keep_stop(i) ? i+1 : i;
+
+            bool trimmed = begin > 0 || end < pts.size();
+            size_t min_size = trimmed ? tangent_samples_ : 2;
+
+            if (end - begin >= min_size) {
+                insert(std::span(pts).subspan(begin, end - begin),
+                    chain.road_type, chain.ef);
+                cut = true;
+            }
         }
     }
 }
 
 
-void RoadGenerator::push_road(std::list<DVector2>& points, size_t road, Eigenfield ef) {
+// tiles are handed out to trace_threads_ workers. a tile's generator only
+// lives while the tile is generated, so memory is bounded by the tile size
+// rather than the viewport.
+void RoadGenerator::generate_tiled() {
+    size_t tile_count = static_cast<size_t>(tiles_x_)*tiles_y_;
+    RVector2 tile_size = {
+        viewport_.width()/tiles_x_,
+        viewport_.height()/tiles_y_
+    };
+
+    std::vector<std::vector<TilePiece>> results(tile_count);
+    std::atomic<size_t> next_tile = 0;
+
+    auto work = [&](size_t, size_t) {
+        for (size_t t=next_tile++; t<tile_count; t=next_tile++) {
+            int tx = static_cast<int>(t % tiles_x_);
+            int ty = static_cast<int>(t / tiles_x_);
+
+            RVector2 min = viewport_.min + RVector2{tile_size.x*tx, tile_size.y*ty};
+            Box<real> core(min, min + tile_size);
+
+            // no gap from rounding along the far edges
+            if (tx == tiles_x_-1) core.max.x = viewport_.max.x;
+            if (ty == tiles_y_-1) core.max.y = viewport_.max.y;
+
+            results[t] = generate_tile(field_, core, viewport_, t);
+            for (TilePiece& piece : results[t]) piece.tile = t;
+        }
+    };
+
+    run_parallel(tile_count, work);
+
+    std::vector<TilePiece> pieces;
+    for (std::vector<TilePiece>& tile : results) {
+        std::move(tile.begin(), tile.end(), std::back_inserter(pieces));
+    }
+
+    stitch_tiles(pieces);
+
+    // joined over the whole viewport once the tiles are stitched
+    if (join_roads_) {
+        for (size_t i=0; i<road_type_count_; ++i) connect_roads(i);
+    }
+}
+
+
+void RoadGenerator::push_road(std::span<const RVector2> points, size_t road, Eigenfield ef) {
     if (points.front() != points.back()) {
-        add_candidate_seed(points.front(), ef.opposite());
-        add_candidate_seed(points.back(), ef.opposite());
+        add_candidate_seed(points.front(), ef.opposite(), road);
+        add_candidate_seed(points.back(), ef.opposite(), road);
     }
 
     insert(points, road, ef);
+
+    for (const RVector2& p : points) coverage_[ef].cover(p, params_[road].d_sep);
 }
 
 
-DVector2 RoadGenerator::tangent(const NodeHandle& handle) const {
+RVector2 RoadGenerator::tangent(const NodeHandle& handle) const {
     const Road& road = get_road(handle);
 
     int idx = handle.idx;
@@ -308,46 +1549,58 @@ DVector2 RoadGenerator::tangent(const NodeHandle& handle) const {
 }
 
 
+// the nearest point of another road within d_lookahead of handle that
+// it leaves for at less than theta_max, ahead of it at an end. nearby is
+// scratch for the query.
 std::optional<NodeHandle>
-RoadGenerator::joining_candidate(const NodeHandle& handle) const {
+RoadGenerator::joining_candidate(const NodeHandle& handle,
+    std::vector<NodeHandle>& nearby) const
+{
     const RoadHandle& road_handle = handle.road_handle;
     const Road& road = get_road(road_handle);
 
-    std::list<NodeHandle> nearby = nearby_points(
+    nearby_points(
         get_pos(handle), 
         params_[road_handle.road_type].d_lookahead,
-        Eigenfield::major() | Eigenfield::minor()
+        Eigenfield::major() | Eigenfield::minor(),
+        nearby
     );
 
-    double theta_max = params_[road_handle.road_type].theta_max;
-    DVector2 pos = get_pos(handle);
-    DVector2 local_dir = tangent(handle);
+    real theta_max = params_[road_handle.road_type].theta_max;
+    RVector2 pos = get_pos(handle);
+    RVector2 local_dir = tangent(handle);
 
     bool is_endpoint = (handle.idx == road.end - 1 || handle.idx == road.begin);
 
     if (handle.idx == road.begin) local_dir = local_dir*-1.0;
 
-    double min_dist2 = std::numeric_limits<double>::infinity();
+    real min_dist2 = std::numeric_limits<real>::infinity();
     std::optional<NodeHandle> best_candidate;
 
+    // nodes apart by the rounding of their coordinates coincide
+    real coincident = 4*d_epsilon*(std::abs(pos.x) + std::abs(pos.y));
+
     for (const NodeHandle& candidate : nearby) {
         if (candidate.road_handle == road_handle) continue;
 
-        DVector2 join_vector = get_pos(candidate) - pos;
+        RVector2 join_vector = get_pos(candidate) - pos;
 
         if (is_endpoint && dot_product(join_vector, local_dir) < 0)
             continue;
 
-        double dist2 = dot_product(join_vector, join_vector);
+        real dist2 = dot_product(join_vector, join_vector);
+
+        // already meets the other road, as stitched roads do at seams
+        if (dist2 <= coincident*coincident) return {};
 
         if (dist2 > min_dist2) continue;
 
-        double leave_angle = std::abs(
+        real leave_angle = std::abs(
             vector_angle(local_dir, join_vector)
         );
 
         if (leave_angle < theta_max) {
-            dist2 = min_dist2;
+            min_dist2 = dist2;
             best_candidate = candidate;
         }
     }
@@ -356,20 +1609,24 @@ RoadGenerator::joining_candidate(const NodeHandle& handle) const {
 }
 
 
-std::list<DVector2>
-RoadGenerator::joining_streamline(double dl, DVector2 x0, DVector2 x1) const {
-    DVector2 diff = (x1 - x0);
-    double dist = std::hypot(diff.x, diff.y);
+std::vector<RVector2>
+RoadGenerator::joining_streamline(real dl, RVector2 x0, RVector2 x1) const {
+    RVector2 diff = (x1 - x0);
+    real dist = std::hypot(diff.x, diff.y);
 
     dl = std::min(dist/tangent_samples_, dl);
 
-    DVector2 inc = diff*dl/dist;
+    RVector2 inc = diff*dl/dist;
+
+    std::vector<RVector2> out = {x0};
 
-    std::list<DVector2> out = {x0};
+    real dl2 = dl*dl;
 
-    double dl2 = dl*dl;
+    // steps lost to rounding on coordinates far larger than dl would never
+    // close the distance, so they are bounded by it
+    int steps = static_cast<int>(std::ceil(dist/dl));
 
-    while (dot_product(diff, diff) > dl2) {
+    while (dot_product(diff, diff) > dl2 && steps-- > 0) {
         out.push_back(out.back() + inc);
         diff = x1 - out.back();
     }
@@ -379,66 +1636,93 @@ RoadGenerator::joining_streamline(double dl, DVector2 x0, DVector2 x1) const {
 }
 
 
-void RoadGenerator::connect_roads(size_t road_type, Eigenfield ef) {
-    RoadHandle road_handle {
-        0,
-        road_type,
-        ef
-    };
+// joins both ends of every road of road_type, but loops, to their joining
+// candidates. the candidates are found on the trace threads against the
+// storage as it stands, then the joins are inserted in order. two ends
+// that chose each other are joined once.
+void RoadGenerator::connect_roads(size_t road_type) {
+    std::vector<NodeHandle> ends;
+
+    for (Eigenfield ef : {Eigenfield::major(), Eigenfield::minor()}) {
+        RoadHandle handle {0, road_type, ef};
 
-    std::uint32_t count = road_count(road_type, ef);
+        for (std::uint32_t idx=0; idx<road_count(road_type, ef); ++idx) {
+            handle.idx = idx;
+            const Road& road = get_road(handle);
 
-    double dl = params_[road_type].node_sep;
+            NodeHandle first = {road.begin, handle};
+            NodeHandle last  = {road.end-1, handle};
 
-    for (std::uint32_t idx = 0; idx < count; ++idx) {
-        road_handle.idx = idx;
-        const Road& road = get_road(road_handle);
+            if (road.is_joining_road || get_pos(first) == get_pos(last)) continue;
 
-        NodeHandle first = { road.begin, road_handle };
-        NodeHandle last  = { road.end-1,   road_handle };
+            ends.push_back(first);
+            ends.push_back(last);
+        }
+    }
 
-        std::optional<NodeHandle> first_join = joining_candidate(first);
-        std::optional<NodeHandle> last_join  = joining_candidate(last);
+    std::vector<std::optional<NodeHandle>> joins(ends.size());
 
-        if (first_join.has_value()) {
-            std::list<DVector2> s_join = joining_streamline(
-                dl,
-                get_pos(first),
-                get_pos(first_join.value())
-            );
+    auto work = [this, &ends, &joins](size_t first, size_t stride) {
+        std::vector<NodeHandle> nearby; // reused by every end of the thread
 
-            insert(s_join, road_type, ef, true);
+        for (size_t i=first; i<ends.size(); i+=stride) {
+            joins[i] = joining_candidate(ends[i], nearby);
         }
-        if (last_join.has_value()) {
-            std::list<DVector2> s_join = joining_streamline(
-                dl,
-                get_pos(last),
-                get_pos(last_join.value())
-            );
-
-            insert(s_join, road_type, ef, true);
+    };
+
+    run_parallel(ends.size(), work);
+
+    std::unordered_map<std::uint32_t, size_t> end_at; // node -> index in ends
+    for (size_t i=0; i<ends.size(); ++i) end_at[ends[i].idx] = i;
+
+    real dl = params_[road_type].node_sep;
+
+    for (size_t i=0; i<ends.size(); ++i) {
+        if (!joins[i].has_value()) continue;
+
+        const NodeHandle& target = joins[i].value();
+
+        auto it = end_at.find(target.idx);
+        if (it != end_at.end() && it->second < i) {
+            const std::optional<NodeHandle>& back = joins[it->second];
+            if (back.has_value() && back->idx == ends[i].idx) continue;
         }
+
+        std::vector<RVector2> s_join = joining_streamline(
+            dl,
+            get_pos(ends[i]),
+            get_pos(target)
+        );
+
+        insert(s_join, road_type, ends[i].road_handle.eigenfield, true);
     }
 }
 
 
 RoadGenerator::RoadGenerator(
-    TensorField* field,
+    const TensorField* field,
     size_t road_type_count,
     GeneratorParameters* parameters,
-    Box<double> viewport
+    Box<real> viewport
 ) :
     viewport_(viewport),
     field_(field),
-    dist_(0.0, 1.0),
+    raster_(field, kDefaultRasterCellSize),
+    degenerate_(field, kDegenerateCellSize),
+    obstacles_(kObstacleCellSize),
     RoadStorage(viewport, kQuadTreeDepth, kQuadTreeLeafCapacity, road_type_count),
     params_(parameters)
 {
+    core_ = viewport;
+    trace_bounds_ = viewport;
 
     for (int i=0; i<road_type_count; ++i) {
+        // only written when out of range, tile generators share params_
         GeneratorParameters& p = params_[i];
-        p.d_test = std::min(p.d_test, p.d_sep);
+        if (p.d_test > p.d_sep) p.d_test = p.d_sep;
     }
+
+    reset_candidates();
 }
 
 
@@ -446,16 +1730,104 @@ size_t RoadGenerator::road_type_count() const {
     return road_type_count_;
 }
 
-void RoadGenerator::reset(Box<double> new_viewport) {
+
+void RoadGenerator::enable_field_raster(real cell_size) {
+    raster_.set_cell_size(cell_size);
+    use_raster_ = true;
+}
+
+
+void RoadGenerator::disable_field_raster() {
+    use_raster_ = false;
+}
+
+void RoadGenerator::set_integrator(Integrator integrator) {
+    integrator_ = integrator;
+}
+
+
+void RoadGenerator::count(std::atomic<std::uint64_t>& counter, std::uint64_t n) const {
+    if (count_trace_) counter.fetch_add(n, std::memory_order_relaxed);
+}
+
+
+void RoadGenerator::set_count_trace(bool count) {
+    count_trace_ = count;
+}
+
+
+RoadGenerator::TraceCounts RoadGenerator::trace_counts() const {
+    return {steps_taken_.load(), steps_rejected_.load(), field_samples_.load(),
+        streamlines_traced_.load(), streamlines_committed_.load(),
+        streamlines_mispredicted_.load()};
+}
+
+
+void RoadGenerator::set_swept_collision(bool swept) {
+    swept_collision_ = swept;
+}
+
+
+void RoadGenerator::set_trace_threads(int threads) {
+    if (threads <= 0) {
+        threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+
+    trace_threads_ = threads;
+}
+
+
+void RoadGenerator::set_verify_speculation(bool verify) {
+    verify_speculation_ = verify;
+}
+
+
+void RoadGenerator::set_lockstep_seeds(int seeds) {
+    lockstep_seeds_ = std::max(0, seeds);
+}
+
+
+void RoadGenerator::set_seed_order(SeedOrder order) {
+    seed_order_ = order;
+}
+
+
+void RoadGenerator::set_join_roads(bool join) {
+    join_roads_ = join;
+}
+
+
+void RoadGenerator::set_tiles(int tiles_x, int tiles_y) {
+    tiles_x_ = std::max(1, tiles_x);
+    tiles_y_ = std::max(1, tiles_y);
+}
+
+
+void RoadGenerator::add_obstacle(std::vector<RVector2> polygon) {
+    obstacles_.add_polygon(std::move(polygon));
+}
+
+
+void RoadGenerator::clear_obstacles() {
+    obstacles_.clear();
+}
+
+
+const ObstacleMask& RoadGenerator::get_obstacles() const {
+    return obstacles_;
+}
+
+
+void RoadGenerator::reset(Box<real> new_viewport) {
     viewport_ = new_viewport;
+    core_ = new_viewport;
+    trace_bounds_ = new_viewport;
     clear();
 }
 
 
 void RoadGenerator::clear() {
-    for (int i=0; i<Eigenfield::count;++i) {
-        seeds_[i] = {};
-    }
+    reset_candidates();
 
     reset_storage(viewport_);
 }
@@ -464,8 +1836,34 @@ void RoadGenerator::clear() {
 void RoadGenerator::generate() {
     clear();
 
+    steps_taken_ = 0;
+    steps_rejected_ = 0;
+    field_samples_ = 0;
+    streamlines_traced_ = 0;
+    streamlines_committed_ = 0;
+    streamlines_mispredicted_ = 0;
+
+    if (trace_threads_ <= 1) {
+        pool_.reset();
+    } else if (!pool_ || pool_->size() != static_cast<size_t>(trace_threads_)) {
+        pool_ = std::make_unique<WorkerPool>(trace_threads_);
+    }
+
+    if (tiles_x_ > 1 || tiles_y_ > 1) {
+        generate_tiled();
+        return;
+    }
+
+    if (use_raster_) raster_.update(viewport_);
+    degenerate_.update(viewport_);
+    obstacles_.update(viewport_);
+
 
     for (int i=0;i<road_type_count_;++i) {
+        RVector2 halo = {params_[i].d_sep, params_[i].d_sep};
+        trace_bounds_ = Box<real>(core_.min - halo, core_.max + halo) & viewport_;
+
         generate_roads(i);
+        if (join_roads_) connect_roads(i);
     }
 }
@@ -1,12 +1,25 @@
 #ifndef GENERATOR_H
 #define GENERATOR_H
 
-#include <queue>
-#include <random>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <unordered_map>
+#include <vector>
 
 #include "../types.h"
 #include "tensor_field.h"
+#include "candidate_seeds.h"
+#include "counter_rng.h"
+#include "coverage_grid.h"
+#include "degenerate_index.h"
+#include "field_raster.h"
+#include "obstacle_mask.h"
 #include "road_storage.h"
+#include "worker_pool.h"
 
 
 enum IntegrationStatus {
@@ -16,117 +29,369 @@ enum IntegrationStatus {
 };
 
 
+enum Integrator {
+    FixedRK4,      // fixed step, a point per step
+    DormandPrince  // adaptive 5(4) steps, points interpolated along them
+};
+
+
 struct Integration {
     IntegrationStatus status;
-    std::optional<DVector2> delta;
-    DVector2 integration_front;
+    std::optional<RVector2> delta;
+    RVector2 integration_front;
     bool negate; 
-    std::list<DVector2> points;
+    std::vector<RVector2> points;   // kept points in tracing order, from the seed out
+
+    // online simplification, see RoadGenerator::trace_point
+    std::optional<RVector2> pending; // the last point traced, not kept yet
+    RVector2 cone_right;             // sides of the chord directions from the
+    RVector2 cone_left;              // last kept point that pass near the dropped
+    bool cone_set = false;           // points, unconstrained until set
+    bool cone_closed = false;        // no chord passes near them all
+    RVector2 tip;                    // the last point traced
+    RVector2 before_tip;             // and the one before it
+    size_t traced = 1;
+
+    // adaptive stepping
+    real step = 0;                  // next trial step, 0 before the first
+    std::optional<RVector2> slope;  // unit tangent at the last step's end
+    std::vector<RVector2> ahead;    // points of the last step
+    size_t next_ahead = 0;          // the first of them not yet taken
+    bool ahead_clear = false;       // swept, no road near the whole step
 
-    Integration(DVector2 seed, bool negate) :
+    Integration(RVector2 seed, bool negate) :
         status(Continue),
         integration_front(seed),
         negate(negate),
-        points({seed})
+        points({seed}),
+        tip(seed),
+        before_tip(seed)
     {}
+
+    bool has_ahead() const { return next_ahead < ahead.size(); }
 };
 
 
 struct GeneratorParameters {
-    int max_seed_retries;
     int max_integration_iterations;
-    double d_sep;
-    double d_sep2;
-    double d_test;
-    double d_test2;
-    double d_circle;
-    double d_circle2;
-    double dl;
-    double dl2;
-    double d_lookahead;
-    double theta_max; // maximum streamline joining angle
-    double epsilon;
-    double node_sep;
-    double node_sep2;
+    real d_sep;
+    real d_sep2;
+    real d_test;
+    real d_test2;
+    real d_circle;
+    real d_circle2;
+    real dl;
+    real dl2;
+    real d_lookahead;
+    real theta_max; // maximum streamline joining angle
+    real epsilon;
+    real node_sep;
+    real node_sep2;
+    std::uint64_t seed; // of the road type's random seeds
 
 
     GeneratorParameters(
-        int max_seed_retries,
         int max_integration_iterations,
-        double d_sep,
-        double d_test,
-        double d_circle,
-        double dl,
-        double d_lookahead,
-        double theta_max,
-        double epsilon,
-        double node_sep
+        real d_sep,
+        real d_test,
+        real d_circle,
+        real dl,
+        real d_lookahead,
+        real theta_max,
+        real epsilon,
+        real node_sep,
+        std::uint64_t seed = 0
     );
 };
 
 
 class RoadGenerator : public RoadStorage {
+    public:
+        // a road of one tile clipped to the tile's core. an open end was cut
+        // at a seam and may be stitched to a neighbouring tile's road.
+        struct TilePiece {
+            std::vector<RVector2> points;
+            size_t road_type;
+            Eigenfield ef;
+            size_t tile;
+            std::array<bool, 2> open; // front, back
+            bool split = false;       // its road left the core and came back
+        };
+
+        struct TileEnd {
+            size_t piece;
+            int side; // 0 front, 1 back
+        };
+
+        using TileLinks = std::vector<std::array<std::optional<TileEnd>, 2>>;
+
+        // work done tracing since generate() began, see set_count_trace()
+        struct TraceCounts {
+            std::uint64_t steps;    // integration steps taken
+            std::uint64_t rejected; // adaptive steps retried smaller
+            std::uint64_t samples;  // field samples
+            std::uint64_t traced;   // streamlines traced, traced again included
+            std::uint64_t committed; // streamlines stored as roads
+            std::uint64_t mispredicted; // see set_verify_speculation()
+        };
+
     private:
-        using seed_queue = std::queue<DVector2>;
+        // a streamline traced speculatively, before it is committed
+        struct Trace {
+            RVector2 seed;
+            Eigenfield ef;
+            std::vector<RVector2> points; // simplified, what would be stored
+        };
+
+        // the two ends of a streamline being traced from its seed. each
+        // grows outwards in a buffer of its own, a double ended buffer for
+        // the streamline that is joined when it is done.
+        struct Spawn {
+            Integration forward;
+            Integration backward;
+            Eigenfield ef;
+            int count = 0;          // points taken
+            bool diverged = false;  // ends were once further than d_circle
+            bool join = false;      // ends met again, close the loop
+
+            Spawn(RVector2 seed, Eigenfield ef);
+        };
+
+        // stage positions of every front stepped together by a lockstep
+        // trace, in structure-of-arrays layout. positions are pushed in
+        // runs of nearby fronts and each run is one batched field sample,
+        // so the field still culls its basis fields per run.
+        struct Wavefront {
+            std::vector<real> xs;
+            std::vector<real> ys;
+            std::vector<real> a;
+            std::vector<real> b;
+            std::vector<RVector2> major;
+            std::vector<RVector2> minor;
+            std::vector<size_t> runs; // start of each run
+            std::uint64_t cell = 0;   // of the last front
+
+            static std::uint64_t cell_of(const RVector2& pos);
+
+            void clear();
+            void begin_front(const RVector2& pos);
+            void push(const RVector2& pos);
+            size_t size() const;
+            RVector2 eigenvector(size_t i, Eigenfield ef) const;
+        };
+
+        // per-front state of a Dormand-Prince step taken in lockstep
+        struct DopriFront {
+            Integration* res;
+            Eigenfield ef;
+            RVector2 x;
+            std::array<RVector2, 7> k;
+            real h;
+        };
+
+        // nodes committed since the current batch was traced, hashed in
+        // cells of the usual test distance so a lookup touches 3x3 cells
+        struct BatchCommits {
+            real cell_size;
+            real longest = 0; // segment of a committed road
+            std::array<std::unordered_map<std::uint64_t, std::vector<RVector2>>,
+                Eigenfield::count> cells;
+
+            BatchCommits(real cell_size);
+
+            void add(std::span<const RVector2> points, Eigenfield ef);
+            bool near(const RVector2& pos, real radius, Eigenfield ef) const;
+        };
+
         static constexpr int kQuadTreeDepth = 10; // area of 3 pixels at 1920x1080
         static constexpr int kQuadTreeLeafCapacity = 10;
+        static constexpr real kDefaultRasterCellSize = 4.0;
+        static constexpr real kDegenerateCellSize = 16.0;
+        static constexpr real kObstacleCellSize = 4.0;
+        static constexpr int kCoverageDivisions = 4; // coverage cells per d_sep
+        // speculative, if not lockstep. fixed, so the roads do not depend on
+        // the thread count, and enough for a few seeds per hardware thread
+        static constexpr int kSeedsPerBatch = 128;
+        static constexpr real kWavefrontCell = 64.0; // extent of a batched run
+        static constexpr real kMaxStepPoints = 8; // adaptive step, in output points
+        static constexpr real kStepTolerance = 0.02; // of epsilon, per step
 
         GeneratorParameters* params_;
-        std::array<seed_queue, Eigenfield::count> seeds_;
-        std::default_random_engine gen_;
-        std::uniform_real_distribution<double> dist_;
+        std::array<CandidateSeeds, Eigenfield::count> seeds_;
+        std::array<CoverageGrid, Eigenfield::count> coverage_; // of the current road type
+        std::array<CounterRng, Eigenfield::count> rng_; // of the current road type
+        std::uint64_t tile_key_ = 0;
 
-        TensorField* field_;
+        const TensorField* field_;
+        FieldRaster raster_;
+        bool use_raster_ = false;
+        DegenerateIndex degenerate_;
+        ObstacleMask obstacles_;
 
         int tangent_samples_ = 5;
-        Box<double> viewport_;
+        int trace_threads_ = 1;
+        int lockstep_seeds_ = 0;
+        SeedOrder seed_order_ = FirstIn;
+        bool join_roads_ = true;
+        bool swept_collision_ = false;
+        Integrator integrator_ = FixedRK4;
+        int tiles_x_ = 1;
+        int tiles_y_ = 1;
+        Box<real> viewport_;
+        Box<real> core_;         // a tile's generator: the tile without halo
+        Box<real> trace_bounds_; // core_ and the current road type's halo
+
+        bool count_trace_ = false;
+        bool verify_speculation_ = false;
+        mutable std::atomic<std::uint64_t> steps_taken_{0};
+        mutable std::atomic<std::uint64_t> steps_rejected_{0};
+        mutable std::atomic<std::uint64_t> field_samples_{0};
+        mutable std::atomic<std::uint64_t> streamlines_traced_{0};
+        mutable std::atomic<std::uint64_t> streamlines_committed_{0};
+        mutable std::atomic<std::uint64_t> streamlines_mispredicted_{0};
+
+        // trace_threads_ threads kept for the parallel sections of
+        // generate(), made by the first generate() that needs them
+        std::unique_ptr<WorkerPool> pool_;
+        void run_parallel(size_t count,
+            const std::function<void(size_t index, size_t stride)>& job) const;
 
-        bool in_bounds(const DVector2& p) const;
+        bool in_bounds(const RVector2& p) const;
+        void count(std::atomic<std::uint64_t>& counter, std::uint64_t n) const;
 
-        void add_candidate_seed(DVector2 pos, Eigenfield ef);
+        void reset_candidates();
+        real seed_key(const RVector2& pos, Eigenfield ef, size_t road_type) const;
+        void add_candidate_seed(RVector2 pos, Eigenfield ef, size_t road_type);
 
-        std::optional<DVector2> get_seed(size_t road_type, Eigenfield ef);
+        void reset_coverage(size_t road_type);
+        std::optional<RVector2> get_seed(size_t road_type, Eigenfield ef);
 
-        DVector2 get_eigenvector(const DVector2& x, const Eigenfield& ef) const;
-        DVector2 integrate_rk4(const DVector2& x, const Eigenfield& ef, const double& dl) const;
+        Tensor sample_field(const RVector2& x) const;
+        RVector2 get_eigenvector(const RVector2& x, const Eigenfield& ef) const;
+        RVector2 integrate_rk4(const RVector2& x, const Eigenfield& ef, const real& dl) const;
+        void sample_eigenvectors(Wavefront& w) const;
 
+        bool accept_dormand_prince(size_t road_type, const std::array<RVector2, 7>& k,
+            real& h, real& h_next) const;
+        void emit_dormand_prince(Integration& res, size_t road_type, const RVector2& x,
+            const std::array<RVector2, 7>& k, real h, real h_next) const;
+        bool step_dormand_prince(Integration& res, size_t road_type, const Eigenfield& ef) const;
+        void step_dormand_prince(std::vector<DopriFront>& fronts, size_t road_type,
+            Wavefront& w) const;
+
+        void check_front(Integration& res, const size_t& road_type, const Eigenfield& ef) const;
+        void apply_rk4(Integration& res, const size_t& road_type, const Eigenfield& ef,
+            RVector2 delta) const;
+        void take_ahead(Integration& res, const size_t& road_type, const Eigenfield& ef) const;
         void extend_road(Integration& res, const size_t& road_type, const Eigenfield& ef) const;
 
-        std::list<DVector2>
-        spawn_road(size_t road_type, DVector2 seed_point, Eigenfield ef);
+        void trace_point(Integration& res, size_t road_type, RVector2 p) const;
+        void flush_points(Integration& res) const;
+        bool record_step(Spawn& s, size_t road_type) const;
+        void finish_spawn(Spawn& s, std::vector<RVector2>& out) const;
+        void spawn_road(size_t road_type, RVector2 seed_point, Eigenfield ef,
+            std::vector<RVector2>& out) const;
 
         int generate_roads(size_t road_type);
 
-        
-        void simplify_streamline(size_t road_type, std::list<DVector2>& points) const;
-        void douglas_peucker(
-            const double& epsilon,
-            const double& min_sep2,
-            std::list<DVector2>& points,
-            std::list<DVector2>::iterator begin,
-            std::list<DVector2>::iterator end
-        ) const;
+        void trace_lockstep(size_t road_type, std::vector<Trace*>& traces) const;
+        void trace_batch(size_t road_type, std::vector<Trace>& batch) const;
+        int generate_roads_parallel(size_t road_type);
+
+        void stitch_tiles(std::vector<TilePiece>& pieces);
+        void generate_tiled();
 
 
-        void push_road(std::list<DVector2>& points, size_t road_type, Eigenfield ef);
 
-        DVector2 tangent(const NodeHandle& handle) const;
+        void push_road(std::span<const RVector2> points, size_t road_type, Eigenfield ef);
 
-        std::optional<NodeHandle> joining_candidate(const NodeHandle& handle) const;
-        std::list<DVector2> joining_streamline(double dl, DVector2 x0, DVector2 x1) const;
-        void connect_roads(size_t road, Eigenfield ef);
+        RVector2 tangent(const NodeHandle& handle) const;
+
+        std::optional<NodeHandle> joining_candidate(const NodeHandle& handle,
+            std::vector<NodeHandle>& nearby) const;
+        std::vector<RVector2> joining_streamline(real dl, RVector2 x0, RVector2 x1) const;
+        void connect_roads(size_t road_type);
 
 
     public:
         RoadGenerator(
-                TensorField* field,
+                const TensorField* field,
                 size_t road_type_count,
                 GeneratorParameters* params,
-                Box<double> viewport
+                Box<real> viewport
             );
 
         size_t road_type_count() const;
-        void reset(Box<double> new_viewport);
+
+        // opt-in: trace against a baked raster of the field over the viewport
+        void enable_field_raster(real cell_size);
+        void disable_field_raster();
+
+        void set_integrator(Integrator integrator);
+
+        // opt-in: counts the work done tracing in trace_counts(), for
+        // benchmarks. the counters are shared by the trace threads. tiles
+        // are traced by generators of their own and not counted.
+        void set_count_trace(bool count);
+        TraceCounts trace_counts() const;
+
+        // opt-in: fronts stop when their last step passes within d_test of
+        // a road, not just its end, so long steps cannot tunnel through one.
+        // adaptive steps are then tested whole rather than at every point.
+        void set_swept_collision(bool swept);
+
+        // threads tracing speculative batches of seeds in generate(). 1
+        // traces serially, 0 uses every hardware thread. a batch draws its
+        // seeds before any of them is committed, so the roads differ from
+        // the serial loop's, but are the same for any number of threads.
+        void set_trace_threads(int threads);
+
+        // opt-in, for tests: every speculative streamline committed without
+        // being traced again is traced again anyway, against the roads as
+        // they stand, and counted in trace_counts() as mispredicted if the
+        // serial loop would have stored anything else for its seed
+        void set_verify_speculation(bool verify);
+
+        // seeds of a speculative batch advanced together, stepping all
+        // their fronts at once with a batched field sample per integration
+        // stage, split over the trace threads. implies speculative batches,
+        // also with a single trace thread. 0 traces one seed at a time.
+        void set_lockstep_seeds(int seeds);
+
+        // which candidate seeds left by road ends are tried first
+        void set_seed_order(SeedOrder order);
+
+        // joins the dangling ends of each road type to the roads ahead of
+        // them once it is generated. on by default.
+        void set_join_roads(bool join);
+
+        // splits generate() into tiles_x by tiles_y tiles, each generated on
+        // its own thread over the tile and a halo of d_sep, then stitched.
+        // stitched roads are cut where they come within d_test of another,
+        // as the serial tracer stops them. 1 by 1 generates the viewport as
+        // a whole.
+        void set_tiles(int tiles_x, int tiles_y);
+
+        // the roads of one tile, traced by a generator of its own over core
+        // and a halo (within limit) and clipped to core. only depends on
+        // the field, the tile and seed, so tiles of the same world match
+        // whenever and wherever they are generated. safe to call from
+        // several threads while obstacles are not edited. traced relative
+        // to origin and returned relative to it, so a tile far from the
+        // world origin keeps its precision in float.
+        std::vector<TilePiece> generate_tile(const TensorField* field,
+            const Box<real>& core, const Box<real>& limit,
+            std::uint64_t seed, const RVector2& origin = {0, 0}) const;
+
+        // links open ends of pieces of different tiles across their seams
+        TileLinks pair_tile_ends(const std::vector<TilePiece>& pieces) const;
+
+        // closed polygons streamlines stop at and seeds are kept out of
+        void add_obstacle(std::vector<RVector2> polygon);
+        void clear_obstacles();
+        const ObstacleMask& get_obstacles() const;
+
+        void reset(Box<real> new_viewport);
         void clear();
         void generate();
 };
@@ -0,0 +1,220 @@
+#include "gradient_raster.h"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+static constexpr char kMagic[8] = {'C', 'G', 'G', 'R', 'A', 'D', '0', '1'};
+
+
+GradientRaster::~GradientRaster() {
+    if (map_ != nullptr) munmap(map_, map_size_);
+}
+
+
+size_t GradientRaster::tile_count(int width, int height) {
+    size_t tx = (width  + kTile - 1) >> kTileShift;
+    size_t ty = (height + kTile - 1) >> kTileShift;
+    return tx*ty;
+}
+
+
+// 3x3 Sobel over the pixels of one row of tiles, normalised to height
+// units per pixel, edges clamped. out holds that row's tiles.
+void GradientRaster::bake_tile_row(const float* heights, int width, int height,
+    int tile_y, std::vector<float>& out)
+{
+    int tiles_x = (width + kTile - 1) >> kTileShift;
+    out.assign(static_cast<size_t>(tiles_x)*kTile*kTile*2, 0.0f);
+
+    auto h = [=](int x, int y) {
+        x = std::clamp(x, 0, width-1);
+        y = std::clamp(y, 0, height-1);
+        return heights[static_cast<size_t>(y)*width + x];
+    };
+
+    int y_begin = tile_y*kTile;
+    int y_end = std::min(height, y_begin + kTile);
+
+    for (int y=y_begin; y<y_end; ++y) {
+        for (int x=0; x<width; ++x) {
+            float gx = (h(x+1, y-1) + 2*h(x+1, y) + h(x+1, y+1))
+                     - (h(x-1, y-1) + 2*h(x-1, y) + h(x-1, y+1));
+            float gy = (h(x-1, y+1) + 2*h(x, y+1) + h(x+1, y+1))
+                     - (h(x-1, y-1) + 2*h(x, y-1) + h(x+1, y-1));
+
+            size_t tile = x >> kTileShift;
+            size_t local = ((y & (kTile-1)) << kTileShift) + (x & (kTile-1));
+
+            float* t = out.data() + (tile*kTile*kTile + local)*2;
+            t[0] = gx/8;
+            t[1] = gy/8;
+        }
+    }
+}
+
+
+std::shared_ptr<GradientRaster> GradientRaster::from_heights(
+    const float* heights, int width, int height, const char* cache_path)
+{
+    if (heights == nullptr || width <= 0 || height <= 0) return nullptr;
+
+    int tiles_y = (height + kTile - 1) >> kTileShift;
+    std::vector<float> row;
+
+    if (cache_path == nullptr) {
+        std::shared_ptr<GradientRaster> out(new GradientRaster());
+        out->storage_.reserve(tile_count(width, height)*kTile*kTile*2);
+
+        for (int ty=0; ty<tiles_y; ++ty) {
+            bake_tile_row(heights, width, height, ty, row);
+            out->storage_.insert(out->storage_.end(), row.begin(), row.end());
+        }
+
+        out->width_ = width;
+        out->height_ = height;
+        out->tiles_x_ = (width + kTile - 1) >> kTileShift;
+        out->tiles_ = out->storage_.data();
+        return out;
+    }
+
+    Header header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.width = width;
+    header.height = height;
+    header.tile = kTile;
+    header.reserved = 0;
+
+    {
+        // streamed a row of tiles at a time, only the source is in memory
+        std::ofstream file(cache_path, std::ios::binary | std::ios::trunc);
+        if (!file) return nullptr;
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        for (int ty=0; ty<tiles_y; ++ty) {
+            bake_tile_row(heights, width, height, ty, row);
+            file.write(reinterpret_cast<const char*>(row.data()),
+                row.size()*sizeof(float));
+        }
+
+        if (!file) return nullptr;
+    }
+
+    return open(cache_path);
+}
+
+
+std::shared_ptr<GradientRaster> GradientRaster::from_image(
+    const char* image_path, const char* cache_path)
+{
+    Image image = LoadImage(image_path);
+    if (image.data == nullptr) return nullptr;
+
+    ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R32);
+
+    auto out = from_heights(static_cast<const float*>(image.data),
+        image.width, image.height, cache_path);
+
+    UnloadImage(image);
+    return out;
+}
+
+
+std::shared_ptr<GradientRaster> GradientRaster::open(const char* cache_path) {
+    int fd = ::open(cache_path, O_RDONLY);
+    if (fd < 0) return nullptr;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+        close(fd);
+        return nullptr;
+    }
+
+    size_t size = static_cast<size_t>(st.st_size);
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file alive
+
+    if (map == MAP_FAILED) return nullptr;
+
+    Header header;
+    std::memcpy(&header, map, sizeof(header));
+
+    bool valid = std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0
+        && header.tile == kTile
+        && header.width > 0 && header.height > 0
+        && size >= sizeof(Header)
+            + tile_count(header.width, header.height)*kTile*kTile*2*sizeof(float);
+
+    if (!valid) {
+        munmap(map, size);
+        return nullptr;
+    }
+
+    std::shared_ptr<GradientRaster> out(new GradientRaster());
+    out->width_ = header.width;
+    out->height_ = header.height;
+    out->tiles_x_ = (header.width + kTile - 1) >> kTileShift;
+    out->map_ = map;
+    out->map_size_ = size;
+    out->tiles_ = reinterpret_cast<const float*>(
+        static_cast<const char*>(map) + sizeof(Header));
+
+    return out;
+}
+
+
+int GradientRaster::width() const {
+    return width_;
+}
+
+
+int GradientRaster::height() const {
+    return height_;
+}
+
+
+bool GradientRaster::is_mapped() const {
+    return map_ != nullptr;
+}
+
+
+const float* GradientRaster::texel(int x, int y) const {
+    size_t tile = static_cast<size_t>(y >> kTileShift)*tiles_x_ + (x >> kTileShift);
+    size_t local = ((y & (kTile-1)) << kTileShift) + (x & (kTile-1));
+
+    return tiles_ + (tile*kTile*kTile + local)*2;
+}
+
+
+RVector2 GradientRaster::sample(real x, real y) const {
+    if (!(x >= 0 && y >= 0 && x <= width_-1 && y <= height_-1))
+        return {0, 0};
+
+    int x0 = std::min(static_cast<int>(x), width_-1);
+    int y0 = std::min(static_cast<int>(y), height_-1);
+    int x1 = std::min(x0+1, width_-1);
+    int y1 = std::min(y0+1, height_-1);
+
+    real fx = x - x0;
+    real fy = y - y0;
+
+    const float* t00 = texel(x0, y0);
+    const float* t10 = texel(x1, y0);
+    const float* t01 = texel(x0, y1);
+    const float* t11 = texel(x1, y1);
+
+    auto lerp2 = [&](int c) {
+        real top    = t00[c] + (t10[c]-t00[c])*fx;
+        real bottom = t01[c] + (t11[c]-t01[c])*fx;
+        return top + (bottom-top)*fy;
+    };
+
+    return {lerp2(0), lerp2(1)};
+}
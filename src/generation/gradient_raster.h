@@ -0,0 +1,75 @@
+#ifndef GRADIENT_RASTER_H
+#define GRADIENT_RASTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "../types.h"
+
+
+// gradient of a heightmap, Sobel filtered once and stored as square tiles
+// of interleaved (gx, gy) floats. tiles either live in memory or in a cache
+// file that is memory mapped, in which case only the tiles that are
+// actually sampled get paged in and the image is never decoded again.
+// read only once built, so safe to sample from several threads.
+class GradientRaster {
+private:
+    static constexpr int kTileShift = 6;
+    static constexpr int kTile = 1 << kTileShift; // pixels per tile side
+
+    struct Header {
+        char magic[8];
+        std::int32_t width;
+        std::int32_t height;
+        std::int32_t tile;
+        std::int32_t reserved;
+    };
+
+    int width_ = 0;
+    int height_ = 0;
+    int tiles_x_ = 0;
+
+    const float* tiles_ = nullptr;
+    std::vector<float> storage_; // when not mapped
+    void* map_ = nullptr;
+    size_t map_size_ = 0;
+
+    GradientRaster() = default;
+
+    static void bake_tile_row(const float* heights, int width, int height,
+        int tile_y, std::vector<float>& out);
+    static size_t tile_count(int width, int height);
+
+    const float* texel(int x, int y) const;
+
+public:
+    ~GradientRaster();
+
+    GradientRaster(const GradientRaster&) = delete;
+    GradientRaster& operator=(const GradientRaster&) = delete;
+
+    // heights row major, width x height. with a cache_path the tiles are
+    // written there and mapped back instead of kept in memory.
+    static std::shared_ptr<GradientRaster> from_heights(const float* heights,
+        int width, int height, const char* cache_path = nullptr);
+
+    // any image raylib can load, as greyscale in [0, 1]
+    static std::shared_ptr<GradientRaster> from_image(const char* image_path,
+        const char* cache_path = nullptr);
+
+    // maps a cache written by either of the above. nullptr if it is
+    // missing or not a gradient cache.
+    static std::shared_ptr<GradientRaster> open(const char* cache_path);
+
+    int width() const;
+    int height() const;
+    bool is_mapped() const;
+
+    // pixel coordinates, pixel centres on integers. height units per pixel,
+    // bilinear, zero outside the image.
+    RVector2 sample(real x, real y) const;
+};
+
+#endif
@@ -0,0 +1,127 @@
+#include "noise_tiles.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "SimplexNoise.h"
+
+
+size_t NoiseTiles::TileKeyHash::operator()(const TileKey& k) const {
+    size_t h = std::hash<int>()(k.octaves);
+    h = h*31 + std::hash<int>()(k.tx);
+    h = h*31 + std::hash<int>()(k.ty);
+    return h;
+}
+
+
+std::unique_ptr<NoiseTiles::Tile> NoiseTiles::bake(const TileKey& key) const {
+    auto tile = std::make_unique<Tile>();
+    SimplexNoise noise;
+
+    constexpr real step = 1.0/kTileSamples;
+
+    for (int j=0; j<=kTileSamples; ++j) {
+        for (int i=0; i<=kTileSamples; ++i) {
+            tile->values[j*(kTileSamples+1) + i] = noise.fractal(
+                key.octaves,
+                static_cast<float>(key.tx + i*step),
+                static_cast<float>(key.ty + j*step)
+            );
+        }
+    }
+
+    return tile;
+}
+
+
+// u, v in lattice cells of the tile
+real NoiseTiles::interpolate(const Tile& tile, real u, real v) {
+    int i = std::min(static_cast<int>(u), kTileSamples-1);
+    int j = std::min(static_cast<int>(v), kTileSamples-1);
+
+    u -= i;
+    v -= j;
+
+    const float* row0 = tile.values.data() + j*(kTileSamples+1) + i;
+    const float* row1 = row0 + (kTileSamples+1);
+
+    real top    = row0[0] + (row0[1]-row0[0])*u;
+    real bottom = row1[0] + (row1[1]-row1[0])*u;
+
+    return top + (bottom-top)*v;
+}
+
+
+// drops the least recently sampled tiles down to 3/4 of kMaxTiles, so a
+// bake past the cap does not evict on every following bake. the caller
+// holds the lock exclusively.
+void NoiseTiles::evict_locked() const {
+    if (tiles_.size() <= kMaxTiles) return;
+
+    std::vector<std::pair<std::uint64_t, TileKey>> ages;
+    ages.reserve(tiles_.size());
+
+    for (const auto& [key, tile] : tiles_) {
+        ages.push_back({tile->last_used.load(std::memory_order_relaxed), key});
+    }
+
+    size_t drop = tiles_.size() - kMaxTiles*3/4;
+    std::nth_element(ages.begin(), ages.begin() + drop, ages.end(),
+        [](const auto& l, const auto& r) { return l.first < r.first; });
+
+    for (size_t i=0; i<drop; ++i) tiles_.erase(ages[i].second);
+}
+
+
+real NoiseTiles::sample(int octaves, real x, real y) const {
+    real fx = std::floor(x);
+    real fy = std::floor(y);
+
+    TileKey key = {octaves, static_cast<int>(fx), static_cast<int>(fy)};
+
+    real u = (x - fx)*kTileSamples;
+    real v = (y - fy)*kTileSamples;
+
+    // tiles are only evicted under the exclusive lock, so the tile is read
+    // with the shared one held
+    {
+        std::shared_lock lock(mutex_);
+        auto it = tiles_.find(key);
+
+        if (it != tiles_.end()) {
+            // stamps only change between bakes, so this rarely writes
+            std::uint64_t now = clock_.load(std::memory_order_relaxed);
+            if (it->second->last_used.load(std::memory_order_relaxed) != now)
+                it->second->last_used.store(now, std::memory_order_relaxed);
+
+            return interpolate(*it->second, u, v);
+        }
+    }
+
+    // bake outside the lock, a racing thread just wastes its copy
+    std::unique_ptr<Tile> tile = bake(key);
+    real out = interpolate(*tile, u, v);
+
+    std::unique_lock lock(mutex_);
+    tile->last_used = clock_.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    if (tiles_.try_emplace(key, std::move(tile)).second) evict_locked();
+
+    return out;
+}
+
+
+size_t NoiseTiles::tile_count() const {
+    std::shared_lock lock(mutex_);
+    return tiles_.size();
+}
+
+
+void NoiseTiles::clear() {
+    std::unique_lock lock(mutex_);
+    tiles_.clear();
+}
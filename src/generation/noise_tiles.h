@@ -0,0 +1,60 @@
+#ifndef NOISE_TILES_H
+#define NOISE_TILES_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "../types.h"
+
+
+// lazily generated cache of fractal simplex noise. noise space is cut into
+// unit tiles, each baked on a (kTileSamples+1)^2 lattice the first time it
+// is touched and bilinearly interpolated afterwards, so a sample costs one
+// lookup instead of one simplex evaluation per octave. at most kMaxTiles
+// are kept, the least recently sampled are dropped first, so a world
+// streamed around the camera does not grow it without bound. safe to sample
+// from several threads.
+class NoiseTiles {
+private:
+    static constexpr int kTileSamples = 32; // lattice cells per noise unit
+    static constexpr size_t kMaxTiles = 4096; // about 4.3 KB each
+
+    struct Tile {
+        std::array<float, (kTileSamples+1)*(kTileSamples+1)> values;
+        mutable std::atomic<std::uint64_t> last_used{0};
+    };
+
+    struct TileKey {
+        int octaves;
+        int tx;
+        int ty;
+
+        bool operator==(const TileKey& other) const = default;
+    };
+
+    struct TileKeyHash {
+        size_t operator()(const TileKey& k) const;
+    };
+
+    mutable std::shared_mutex mutex_;
+    mutable std::unordered_map<TileKey, std::unique_ptr<Tile>, TileKeyHash> tiles_;
+    mutable std::atomic<std::uint64_t> clock_{0}; // advanced by every bake
+
+    static real interpolate(const Tile& tile, real u, real v);
+    std::unique_ptr<Tile> bake(const TileKey& key) const;
+    void evict_locked() const;
+
+public:
+    // x, y in noise units, result in [-1, 1]
+    real sample(int octaves, real x, real y) const;
+
+    size_t tile_count() const;
+    void clear();
+};
+
+#endif
@@ -0,0 +1,201 @@
+#include "obstacle_mask.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+// even-odd rule
+static bool polygon_contains(const std::vector<RVector2>& poly, const RVector2& pos) {
+    bool inside = false;
+
+    for (size_t i=0, j=poly.size()-1; i<poly.size(); j=i++) {
+        const RVector2& p = poly[i];
+        const RVector2& q = poly[j];
+
+        if ((p.y <= pos.y) != (q.y <= pos.y)) {
+            real x = p.x + (pos.y - p.y)*(q.x - p.x)/(q.y - p.y);
+            if (pos.x < x) inside = !inside;
+        }
+    }
+
+    return inside;
+}
+
+
+ObstacleMask::ObstacleMask(real cell_size) :
+    cell_size_(cell_size)
+{
+    assert(cell_size_ > 0.0);
+}
+
+
+void ObstacleMask::add_polygon(std::vector<RVector2> polygon) {
+    if (polygon.size() > 1 && polygon.front() == polygon.back())
+        polygon.pop_back();
+
+    if (polygon.size() < 3) return;
+
+    polygons_.push_back(std::move(polygon));
+    ++version_;
+}
+
+
+void ObstacleMask::clear() {
+    polygons_.clear();
+    ++version_;
+}
+
+
+size_t ObstacleMask::size() const {
+    return polygons_.size();
+}
+
+
+const std::vector<RVector2>& ObstacleMask::get_polygon(size_t idx) const {
+    return polygons_[idx];
+}
+
+
+real ObstacleMask::band() const {
+    return kBandCells*cell_size_;
+}
+
+
+bool ObstacleMask::is_stale(const Box<real>& bounds) const {
+    return !built_
+        || built_version_ != version_
+        || !(bounds == bounds_);
+}
+
+
+// scanline fill of every lattice row, one polygon at a time
+void ObstacleMask::fill_inside(std::vector<unsigned char>& inside) const {
+    std::vector<real> crossings;
+
+    for (int j=0; j<rows_; ++j) {
+        real y = bounds_.min.y + j*cell_size_;
+
+        for (const std::vector<RVector2>& poly : polygons_) {
+            crossings.clear();
+
+            for (size_t i=0, k=poly.size()-1; i<poly.size(); k=i++) {
+                const RVector2& p = poly[i];
+                const RVector2& q = poly[k];
+
+                if ((p.y <= y) != (q.y <= y)) {
+                    crossings.push_back(p.x + (y - p.y)*(q.x - p.x)/(q.y - p.y));
+                }
+            }
+
+            std::sort(crossings.begin(), crossings.end());
+
+            for (size_t c=0; c+1<crossings.size(); c+=2) {
+                int i0 = static_cast<int>(std::ceil((crossings[c]   - bounds_.min.x)/cell_size_));
+                int i1 = static_cast<int>(std::ceil((crossings[c+1] - bounds_.min.x)/cell_size_));
+
+                i0 = std::max(i0, 0);
+                i1 = std::min(i1, cols_);
+
+                for (int i=i0; i<i1; ++i) inside[j*cols_ + i] = 1;
+            }
+        }
+    }
+}
+
+
+// lower the unsigned distance of lattice points in the edge's band
+void ObstacleMask::splat_edge(const RVector2& x0, const RVector2& x1) {
+    real r = band();
+
+    int i0 = static_cast<int>(std::floor((std::min(x0.x, x1.x) - r - bounds_.min.x)/cell_size_));
+    int i1 = static_cast<int>(std::ceil ((std::max(x0.x, x1.x) + r - bounds_.min.x)/cell_size_));
+    int j0 = static_cast<int>(std::floor((std::min(x0.y, x1.y) - r - bounds_.min.y)/cell_size_));
+    int j1 = static_cast<int>(std::ceil ((std::max(x0.y, x1.y) + r - bounds_.min.y)/cell_size_));
+
+    i0 = std::max(i0, 0);
+    j0 = std::max(j0, 0);
+    i1 = std::min(i1, cols_-1);
+    j1 = std::min(j1, rows_-1);
+
+    for (int j=j0; j<=j1; ++j) {
+        for (int i=i0; i<=i1; ++i) {
+            RVector2 p = bounds_.min + RVector2{i*cell_size_, j*cell_size_};
+
+            real& d = sdf_[j*cols_ + i];
+            d = std::min(d, segment_distance(p, x0, x1));
+        }
+    }
+}
+
+
+void ObstacleMask::update(const Box<real>& bounds) {
+    if (!is_stale(bounds)) return;
+
+    bounds_ = bounds;
+    cols_ = static_cast<int>(std::ceil(bounds.width()/cell_size_)) + 1;
+    rows_ = static_cast<int>(std::ceil(bounds.height()/cell_size_)) + 1;
+
+    sdf_.assign(cols_*rows_, band());
+
+    for (const std::vector<RVector2>& poly : polygons_) {
+        for (size_t i=0, k=poly.size()-1; i<poly.size(); k=i++) {
+            splat_edge(poly[k], poly[i]);
+        }
+    }
+
+    std::vector<unsigned char> inside(cols_*rows_, 0);
+    fill_inside(inside);
+
+    for (size_t k=0; k<sdf_.size(); ++k) {
+        if (inside[k]) sdf_[k] = -sdf_[k];
+    }
+
+    built_version_ = version_;
+    built_ = true;
+}
+
+
+real ObstacleMask::exact_distance(const RVector2& pos) const {
+    real d = band();
+    bool inside = false;
+
+    for (const std::vector<RVector2>& poly : polygons_) {
+        for (size_t i=0, k=poly.size()-1; i<poly.size(); k=i++) {
+            d = std::min(d, segment_distance(pos, poly[k], poly[i]));
+        }
+
+        inside = inside || polygon_contains(poly, pos);
+    }
+
+    return inside ? -d : d;
+}
+
+
+real ObstacleMask::distance(const RVector2& pos) const {
+    if (polygons_.empty()) return band();
+
+    if (!built_ || !bounds_.contains(pos))
+        return exact_distance(pos);
+
+    RVector2 local = (pos - bounds_.min)/cell_size_;
+
+    int i = std::min(static_cast<int>(local.x), cols_-2);
+    int j = std::min(static_cast<int>(local.y), rows_-2);
+
+    real fx = local.x - i;
+    real fy = local.y - j;
+
+    const real* row0 = sdf_.data() + j*cols_ + i;
+    const real* row1 = row0 + cols_;
+
+    real top    = row0[0] + (row0[1]-row0[0])*fx;
+    real bottom = row1[0] + (row1[1]-row1[0])*fx;
+    return top + (bottom-top)*fy;
+}
+
+
+bool ObstacleMask::blocked(const RVector2& pos, real clearance) const {
+    if (polygons_.empty()) return false;
+
+    return distance(pos) < clearance;
+}
@@ -0,0 +1,56 @@
+#ifndef OBSTACLE_MASK_H
+#define OBSTACLE_MASK_H
+
+#include <cstdint>
+#include <vector>
+
+#include "../types.h"
+
+
+// polygon obstacles (coastlines, rivers, parks) baked into a signed
+// distance raster, negative inside any polygon. distances are only exact
+// within a narrow band around the edges and clamped beyond it, which is
+// all the generator needs to stop streamlines and reject seeds.
+class ObstacleMask {
+private:
+    static constexpr int kBandCells = 4;
+
+    real cell_size_;
+    std::vector<std::vector<RVector2>> polygons_; // closed, last != first
+
+    Box<real> bounds_;
+    int cols_ = 0;
+    int rows_ = 0;
+    std::vector<real> sdf_; // row major, rows_ x cols_
+
+    std::uint64_t version_ = 0;
+    std::uint64_t built_version_ = 0;
+    bool built_ = false;
+
+    real band() const;
+    void fill_inside(std::vector<unsigned char>& inside) const;
+    void splat_edge(const RVector2& x0, const RVector2& x1);
+    real exact_distance(const RVector2& pos) const;
+
+public:
+    ObstacleMask(real cell_size);
+
+    void add_polygon(std::vector<RVector2> polygon);
+    void clear();
+    size_t size() const;
+    const std::vector<RVector2>& get_polygon(size_t idx) const;
+
+    bool is_stale(const Box<real>& bounds) const;
+
+    // rasterizes again if polygons were edited or bounds changed
+    void update(const Box<real>& bounds);
+
+    // signed distance to the nearest obstacle edge, clamped to the band.
+    // bilinear inside the baked bounds, exact outside.
+    real distance(const RVector2& pos) const;
+
+    // pos is inside an obstacle or within clearance of one
+    bool blocked(const RVector2& pos, real clearance = 0) const;
+};
+
+#endif
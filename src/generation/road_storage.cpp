@@ -1,25 +1,47 @@
 #include "road_storage.h"
 
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
 
-std::array<std::pair<ef_mask, std::list<NodeHandle>>, 4> 
-RoadStorage::partition(const Box<double>& bbox, std::list<NodeHandle>& s) {
-    DVector2 mid = middle(bbox.min, bbox.max);
+
+#ifdef SINGLE_PRECISION
+static_assert(sizeof(RVector2) == sizeof(Vector2)
+    && std::is_standard_layout_v<RVector2>);
+#endif
+
+
+// reorders s into its quadrants in place, keeping the order within each
+std::array<std::pair<ef_mask, std::span<NodeHandle>>, 4> 
+RoadStorage::partition(const Box<real>& bbox, std::span<NodeHandle> s) {
+    RVector2 mid = middle(bbox.min, bbox.max);
 
     auto quadrant_id = [&mid, this](const NodeHandle& h) {
-        const DVector2& pos = get_pos(h);
+        const RVector2& pos = get_pos(h);
         return (pos.x > mid.x) + ((pos.y > mid.y)<<1);
     };
 
+    std::array<size_t, 5> offsets = {};
+    std::array<ef_mask, 4> eigenfields = {};
 
+    for (const NodeHandle& h : s) {
+        int q = quadrant_id(h);
+        ++offsets[q+1];
+        eigenfields[q] |= get_eigenfields(h);
+    }
 
-    std::array<std::pair<ef_mask, std::list<NodeHandle>>, 4> out;
+    for (int q=0; q<4; ++q) offsets[q+1] += offsets[q];
 
-    for (auto it = s.begin(); it != s.end();) {
-        auto curr = it++;
-        int q = quadrant_id(*curr);
+    // counting sort through a buffer kept between inserts
+    partition_scratch_.assign(s.begin(), s.end());
+    std::array<size_t, 4> next = {offsets[0], offsets[1], offsets[2], offsets[3]};
 
-        out[q].first |= get_eigenfields(*curr);
-        out[q].second.splice(out[q].second.end(), s, curr);
+    for (const NodeHandle& h : partition_scratch_) s[next[quadrant_id(h)]++] = h;
+
+    std::array<std::pair<ef_mask, std::span<NodeHandle>>, 4> out;
+
+    for (int q=0; q<4; ++q) {
+        out[q] = {eigenfields[q], s.subspan(offsets[q], offsets[q+1] - offsets[q])};
     }
 
     return out;
@@ -38,43 +60,57 @@ bool RoadStorage::is_leaf(const qnode_id& id) const {
 
 
 void RoadStorage::append_leaf_data(const qnode_id& leaf_ptr,
-    const ef_mask& eigenfields, std::list<NodeHandle>& data) 
+    const ef_mask& eigenfields, std::span<const NodeHandle> data) 
 {
     QuadNode& leaf = qnodes_[leaf_ptr];
 
     leaf.eigenfields |= eigenfields;
-    leaf.data.splice(leaf.data.end(), data);
+
+    // a leaf fills up to its capacity before it splits, allocate that once
+    if (leaf.data.empty()) leaf.data.reserve(std::max<size_t>(leaf_capacity_, data.size()));
+    leaf.data.insert(leaf.data.end(), data.begin(), data.end());
 }
 
 
 void RoadStorage::insert_rec(const int& depth, const qnode_id& head_ptr, 
-    const ef_mask& eigenfields, std::list<NodeHandle>& list)
+    const ef_mask& eigenfields, std::span<NodeHandle> handles)
 {
 
     // base cases
     if (depth >= max_depth_) {
         // 1: Max Depth Exceeded 
-        append_leaf_data(head_ptr, eigenfields, list);
+        append_leaf_data(head_ptr, eigenfields, handles);
         return;
     } 
-    else if (is_leaf(head_ptr)) {
-        if (qnodes_[head_ptr].data.size() + list.size() <= leaf_capacity_) {
+
+    // a full leaf is split, its data goes down with the new handles
+    std::vector<NodeHandle> split;
+
+    if (is_leaf(head_ptr)) {
+        std::vector<NodeHandle>& data = qnodes_[head_ptr].data;
+
+        if (data.size() + handles.size() <= leaf_capacity_) {
             // 2: Leaf has space
-            append_leaf_data(head_ptr, eigenfields, list);
+            append_leaf_data(head_ptr, eigenfields, handles);
             return;
         }
 
-        list.splice(list.end(), qnodes_[head_ptr].data);
+        split.reserve(handles.size() + data.size());
+        split.insert(split.end(), handles.begin(), handles.end());
+        split.insert(split.end(), data.begin(), data.end());
+        data = {};
+
+        handles = split;
     }
 
     qnodes_[head_ptr].eigenfields |= eigenfields;
 
-    Box<double> bbox = qnodes_[head_ptr].bbox;
-    auto parts = partition(bbox, list);
+    Box<real> bbox = qnodes_[head_ptr].bbox;
+    auto parts = partition(bbox, handles);
 
     int next_depth = depth+1;
 
-    std::array<Box<double>, 4> quadrants = bbox.quadrants();
+    std::array<Box<real>, 4> quadrants = bbox.quadrants();
 
     for (int q=0;q<4;++q) {
         auto& [sub_dirs, sublist] = parts[q];
@@ -120,7 +156,7 @@ RoadStorage::in_circle_rec(const qnode_id& head_ptr,
         for (const NodeHandle& handle : head.data) {
             if (!(get_eigenfields(handle) & query.eigenfields)) continue;
 
-            DVector2 diff = query.centre - get_pos(handle);
+            RVector2 diff = query.centre - get_pos(handle);
             if (dot_product(diff, diff) > query.radius2) continue;
 
             if (query.gather) query.harvest.push_back(handle);
@@ -213,8 +249,54 @@ RoadStorage::gather_data_rec(const qnode_id& head_ptr, BBoxQuery& query) const {
 }
 
 
+// tests the segments on either side of every node close enough to end one
+// within radius of the query segment
+bool
+RoadStorage::in_segment_rec(const qnode_id& head_ptr, const SegmentQuery& query) const {
+    const QuadNode& head = qnodes_[head_ptr];
+
+    if ((query.bbox & head.bbox).is_empty() || !(head.eigenfields & query.eigenfields))
+        return false;
+
+    if (is_leaf(head_ptr)) {
+        real reach = query.radius + max_segment_/2;
+
+        for (const NodeHandle& hd : head.data) {
+            if (!(get_eigenfields(hd) & query.eigenfields)) continue;
+
+            const RVector2& p = get_pos(hd);
+            if (!query.bbox.contains(p)
+                || segment_distance(p, query.x0, query.x1) > reach) continue;
+
+            const Road& road = get_road(hd);
+
+            if (hd.idx > road.begin
+                && segments_distance(query.x0, query.x1, nodes_[hd.idx-1], p) <= query.radius)
+                return true;
+
+            if (hd.idx+1 < road.end
+                && segments_distance(query.x0, query.x1, p, nodes_[hd.idx+1]) <= query.radius)
+                return true;
+
+            if (road.end - road.begin == 1
+                && segment_distance(p, query.x0, query.x1) <= query.radius)
+                return true;
+        }
+
+        return false;
+    }
+
+    for (const qnode_id& child_ptr : head.children) {
+        if (child_ptr == NullQNode) continue;
+        if (in_segment_rec(child_ptr, query)) return true;
+    }
+
+    return false;
+}
+
+
 RoadStorage::RoadStorage(
-    Box<double> viewport,
+    Box<real> viewport,
     int depth,
     int leaf_capacity,
     size_t road_type_count
@@ -229,7 +311,7 @@ RoadStorage::RoadStorage(
 }
 
 
-const DVector2& RoadStorage::get_pos(const NodeHandle& h) const {
+const RVector2& RoadStorage::get_pos(const NodeHandle& h) const {
     return nodes_[h.idx];
 }
 
@@ -249,14 +331,17 @@ const Road& RoadStorage::get_road(const NodeHandle& h) const {
 }
 
 
-void RoadStorage::reset_storage(Box<double> new_viewport) {
+void RoadStorage::reset_storage(Box<real> new_viewport) {
     viewport_ = new_viewport;
     root_ = 0;
     qnodes_.clear();
     qnodes_.emplace_back(new_viewport, 0);
 
     nodes_.clear();
+    max_segment_ = 0;
+#ifndef SINGLE_PRECISION
     fnodes_.clear();
+#endif
 
     for (int i=0; i< road_type_count_; ++i) {
         for (int j=0; j < Eigenfield::count; ++j) {
@@ -266,11 +351,12 @@ void RoadStorage::reset_storage(Box<double> new_viewport) {
 }
 
 
-void RoadStorage::insert(const std::list<DVector2>& points,
+void RoadStorage::insert(std::span<const RVector2> points,
     size_t road_type, Eigenfield eigenfield, bool is_join) {
     if (points.size() == 0) return;
 
-    std::list<NodeHandle> node_handles;
+    std::vector<NodeHandle>& node_handles = insert_handles_;
+    node_handles.clear();
 
     Road new_road = {
         static_cast<std::uint32_t>(nodes_.size()),
@@ -288,11 +374,19 @@ void RoadStorage::insert(const std::list<DVector2>& points,
 
     std::uint32_t idx = nodes_.size();
 
-    for (const auto& pt : points) {
+    nodes_.insert(nodes_.end(), points.begin(), points.end());
+#ifndef SINGLE_PRECISION
+    fnodes_.insert(fnodes_.end(), points.begin(), points.end());
+#endif
+
+    for (size_t i=1; i<points.size(); ++i) {
+        RVector2 d = points[i] - points[i-1];
+        max_segment_ = std::max(max_segment_, std::sqrt(dot_product(d, d)));
+    }
+
+    for (size_t i=0; i<points.size(); ++i) {
         assert(idx != -1);
 
-        nodes_.push_back(pt);
-        fnodes_.push_back(pt);
         node_handles.push_back({
             idx,
             new_road_handle
@@ -313,7 +407,12 @@ RoadStorage::get_road_points(const RoadHandle& road_handle) const {
 
     return {
         road.end - road.begin,
+#ifdef SINGLE_PRECISION
+        // float nodes already have raylib's Vector2 layout, no mirror needed
+        reinterpret_cast<const Vector2*>(nodes_.data()) + road.begin
+#else
         fnodes_.data() + road.begin
+#endif
     };
 }
 
@@ -324,17 +423,46 @@ std::uint32_t RoadStorage::road_count(size_t road_type, Eigenfield eigenfield) c
 
 
 bool 
-RoadStorage::has_nearby_point(DVector2 centre, double radius, ef_mask eigenfields) const {
+RoadStorage::has_nearby_point(RVector2 centre, real radius, ef_mask eigenfields) const {
     CircleQuery query(eigenfields, centre, radius, false);
     return in_circle_rec(root_, query);
 }
 
 
-std::list<NodeHandle>
-RoadStorage::nearby_points(DVector2 centre, double radius, ef_mask eigenfields) const {
+std::vector<NodeHandle>
+RoadStorage::nearby_points(RVector2 centre, real radius, ef_mask eigenfields) const {
+    std::vector<NodeHandle> out;
+    nearby_points(centre, radius, eigenfields, out);
+    return out;
+}
+
+
+bool RoadStorage::has_nearby_segment(RVector2 x0, RVector2 x1, real radius,
+    ef_mask eigenfields) const
+{
+    RVector2 reach = RVector2{1, 1}*(radius + max_segment_/2);
+
+    SegmentQuery query = {
+        eigenfields, x0, x1, radius,
+        Box<real>(
+            RVector2{std::min(x0.x, x1.x), std::min(x0.y, x1.y)} - reach,
+            RVector2{std::max(x0.x, x1.x), std::max(x0.y, x1.y)} + reach
+        )
+    };
+
+    return in_segment_rec(root_, query);
+}
+
+
+void RoadStorage::nearby_points(RVector2 centre, real radius, ef_mask eigenfields,
+    std::vector<NodeHandle>& out) const
+{
     CircleQuery query(eigenfields, centre, radius, true);
+
+    out.clear();
+    query.harvest.swap(out);
     in_circle_rec(root_, query);
-    return query.harvest;
+    out.swap(query.harvest);
 }
 
 
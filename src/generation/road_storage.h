@@ -5,7 +5,7 @@
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
-#include <list>
+#include <span>
 #include <vector>
 
 #include "../types.h"
@@ -94,11 +94,11 @@ struct NodeHandle {
 };
 
 struct QuadNode {
-    Box<double> bbox;
-    std::list<NodeHandle> data;
+    Box<real> bbox;
+    std::vector<NodeHandle> data;
     qnode_id children[4] = {NullQNode, NullQNode, NullQNode, NullQNode};
     ef_mask eigenfields;
-    QuadNode(Box<double> bounding_box, ef_mask eigenfields) :
+    QuadNode(Box<real> bounding_box, ef_mask eigenfields) :
         bbox(bounding_box),
         eigenfields(eigenfields)
     {}
@@ -111,24 +111,24 @@ private:
     struct BBoxQuery {
         ef_mask eigenfields;
         bool gather;
-        Box<double> inner_bbox;
-        std::list<NodeHandle> harvest;
+        Box<real> inner_bbox;
+        std::vector<NodeHandle> harvest;
     };
 
     struct CircleQuery : BBoxQuery {
-        DVector2 centre;
-        double radius;
-        double radius2;
-        Box<double> outer_bbox;
-        CircleQuery(ef_mask eigenfields, DVector2 c, double r, bool g) : 
+        RVector2 centre;
+        real radius;
+        real radius2;
+        Box<real> outer_bbox;
+        CircleQuery(ef_mask eigenfields, RVector2 c, real r, bool g) : 
             BBoxQuery({eigenfields, g}),
             centre(c),
             radius(r) 
         {
             radius2 = radius*radius;
 
-            DVector2 circumscribed_diag = {radius, radius};
-            DVector2 inscribed_diag = circumscribed_diag/M_SQRT2;
+            RVector2 circumscribed_diag = {radius, radius};
+            RVector2 inscribed_diag = circumscribed_diag/M_SQRT2;
 
             outer_bbox = Box (
                 centre - circumscribed_diag,
@@ -143,13 +143,26 @@ private:
         }
     };
 
+    struct SegmentQuery {
+        ef_mask eigenfields;
+        RVector2 x0;
+        RVector2 x1;
+        real radius;
+        Box<real> bbox; // of the nodes that can end a segment within radius
+    };
+
     // node storage
-    std::vector<DVector2> nodes_;
+    std::vector<RVector2> nodes_;
+#ifndef SINGLE_PRECISION
     std::vector<Vector2> fnodes_; // quick conversion to float for rendering
+#endif
     std::vector<std::array<std::vector<Road>, Eigenfield::count>> roads_;
+    std::vector<NodeHandle> insert_handles_;    // scratch of insert
+    std::vector<NodeHandle> partition_scratch_; // and of partition
+    real max_segment_ = 0; // longest segment between two nodes of a road
 
     // quadtree
-    Box<double> viewport_;
+    Box<real> viewport_;
 
 #ifdef STORAGE_TEST
 public:
@@ -161,22 +174,22 @@ public:
 
 
 
-    std::array<std::pair<ef_mask, std::list<NodeHandle>>, 4> 
-        partition(const Box<double>& bbox, std::list<NodeHandle>& s);
+    std::array<std::pair<ef_mask, std::span<NodeHandle>>, 4> 
+        partition(const Box<real>& bbox, std::span<NodeHandle> s);
 
     bool is_leaf(const qnode_id& id) const;
 
     void append_leaf_data(
         const qnode_id& leaf_ptr,
         const ef_mask& eigenfields,
-        std::list<NodeHandle>& data
+        std::span<const NodeHandle> data
     );
 
     void insert_rec(
         const int& depth, 
         const qnode_id& head_ptr,
         const ef_mask& dirs,
-        std::list<NodeHandle>& list
+        std::span<NodeHandle> handles
     );
 
     bool in_circle_rec(
@@ -194,42 +207,64 @@ public:
         BBoxQuery& query
     ) const;
 
+    bool in_segment_rec(
+        const qnode_id& head_ptr,
+        const SegmentQuery& query
+    ) const;
+
 protected:
     size_t road_type_count_;
     RoadStorage(
-        Box<double> viewport,
+        Box<real> viewport,
         int depth,
         int leaf_capacity,
         size_t road_type_count
     );
 
-    const DVector2& get_pos(const NodeHandle& h) const;
+    const RVector2& get_pos(const NodeHandle& h) const;
     ef_mask get_eigenfields(const NodeHandle& h) const;
 
     const Road& get_road(const RoadHandle& h) const;
     const Road& get_road(const NodeHandle& h) const;
 
-    void reset_storage(Box<double> new_viewport);
+    void reset_storage(Box<real> new_viewport);
 
     void insert(
-        const std::list<DVector2>& points,
+        std::span<const RVector2> points,
         size_t road_type,
         Eigenfield eigenfield,
         bool is_join = false
     );
     
     bool has_nearby_point(
-        DVector2 centre,
-        double radius,
+        RVector2 centre,
+        real radius,
+        ef_mask eigenfields
+    ) const;
+
+    std::vector<NodeHandle> nearby_points(
+        RVector2 centre,
+        real radius,
         ef_mask eigenfields
     ) const;
 
-    std::list<NodeHandle> nearby_points(
-        DVector2 centre,
-        double radius,
+    // is a segment of a road within radius of the segment x0 x1. catches
+    // roads a long step passes through between nodes, unlike a point query
+    bool has_nearby_segment(
+        RVector2 x0,
+        RVector2 x1,
+        real radius,
         ef_mask eigenfields
     ) const;
 
+    // into out, reusing its buffer
+    void nearby_points(
+        RVector2 centre,
+        real radius,
+        ef_mask eigenfields,
+        std::vector<NodeHandle>& out
+    ) const;
+
 public:
     std::pair<size_t, const Vector2*> get_road_points(const RoadHandle& road_handle) const;
     std::uint32_t road_count(size_t road_type, Eigenfield eigenfield) const;
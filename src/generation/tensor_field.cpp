@@ -1,5 +1,9 @@
 #include "tensor_field.h"
+#include <algorithm>
 #include <cstddef>
+#include <utility>
+
+#include "SimplexNoise.h"
 
 
 // ****** Tensor ******
@@ -9,71 +13,86 @@ Tensor Tensor::degenerate() {
 }
 
 
-Tensor Tensor::from_a_b(const double& a, const double& b) {
-    Tensor out = Tensor {a, b};
-    out.set_r_theta();
-    return out;
-}
-
-
-void Tensor::set_r_theta() {
-    r = std::hypot(a, b);
-    if (is_degenerate()) {
-        theta = 0;
-    }
-    else {
-        theta = std::atan2(b/r, a/r)/2.0;
-    }
+Tensor Tensor::from_a_b(const real& a, const real& b) {
+    return Tensor {a, b};
 }
 
 
-Tensor Tensor::from_r_theta(const double& r, const double& theta) {
+Tensor Tensor::from_r_theta(const real& r, const real& theta) {
     return Tensor {
         r*std::cos(2*theta),
-        r*std::sin(2*theta),
-        r,
-        theta,
+        r*std::sin(2*theta)
     };
 }
 
 
-Tensor Tensor::from_xy(const DVector2& xy) {
-    const double& x = xy.x;
-    const double& y = xy.y;
+Tensor Tensor::from_xy(const RVector2& xy) {
+    const real& x = xy.x;
+    const real& y = xy.y;
 
     return from_a_b(y*y - x*x, -2*x*y);
 }
 
 
+real Tensor::get_r() const {
+    return std::hypot(a, b);
+}
+
+
+real Tensor::get_theta() const {
+    if (is_degenerate()) return 0;
+    return std::atan2(b, a)/2;
+}
+
+
 bool Tensor::is_degenerate() const {
-    return std::abs(r) <= d_epsilon;
+    return a*a + b*b <= d_epsilon*d_epsilon;
 }
 
 
+RVector2 Tensor::half_angle(const real& a, const real& b, const real& r) {
+    // (a, b)/r = (cos 2θ, sin 2θ) with θ in (-π/2, π/2], so cos θ >= 0 and
+    // sin θ takes the sign of b. the larger of the two comes from the
+    // half angle formula, the other from sin 2θ = 2 sin θ cos θ, which
+    // avoids cancellation near θ = ±π/2.
+    real cos_2t = a/r;
+
+    if (cos_2t >= 0) {
+        real cos_t = std::sqrt((1 + cos_2t)/2);
+        return {cos_t, b/(2*r*cos_t)};
+    }
+
+    real sin_t = std::copysign(std::sqrt((1 - cos_2t)/2), b);
+    return {b/(2*r*sin_t), sin_t};
+}
+
 
-DVector2 Tensor::get_major_eigenvector() const {
+RVector2 Tensor::get_major_eigenvector() const {
     if (is_degenerate()) return {0.0, 0.0};
 
-    return {
-        std::cos(theta),
-        std::sin(theta)
-    };
+    return half_angle(a, b, std::sqrt(a*a + b*b));
 }
 
-DVector2 Tensor::get_minor_eigenvector() const {
+RVector2 Tensor::get_minor_eigenvector() const {
     if (is_degenerate()) return {0.0, 0.0};
+
+    RVector2 major = half_angle(a, b, std::sqrt(a*a + b*b));
     return {
-        std::sin(theta),
-        std::cos(theta)*-1.0
+        major.y,
+        -major.x
     };
 }
 
 
-Tensor Tensor::rotate(const double& angle) const {
-    return Tensor::from_r_theta(
-        r,
-        std::fmodf(theta + angle, 2.0f*M_PI)
-    );
+Tensor Tensor::rotate(const real& angle) const {
+    // rotating the eigenvectors by φ rotates (a, b) by 2φ
+    real c = std::cos(2*angle);
+    real s = std::sin(2*angle);
+
+    return Tensor {
+        a*c - b*s,
+        a*s + b*c
+    };
 }
 
 
@@ -82,77 +101,79 @@ Tensor Tensor::operator+(const Tensor& other) const {
 }
 
 
-Tensor Tensor::operator*(const double& right) const {
+Tensor Tensor::operator*(const real& right) const {
     return Tensor(right*a, right*b);
 }
 
 
-Tensor operator*(double left, const Tensor& right) {
+Tensor operator*(real left, const Tensor& right) {
     return Tensor(left*right.a, left*right.b);
 }
 
 
 // ****** BasisField ******
 
-BasisField::BasisField(DVector2 centre) 
+BasisField::BasisField(RVector2 centre) 
     : centre_(centre), size_(0), decay_(0) {}
 
 
-BasisField::BasisField(DVector2 centre, double size, double decay) 
+BasisField::BasisField(RVector2 centre, real size, real decay) 
     : centre_(centre), size_(size), decay_(decay) {}
 
 
-const DVector2& BasisField::get_centre() const {
+const RVector2& BasisField::get_centre() const {
     return centre_;
 }
 
 
-const double& BasisField::get_size() const {
+const real& BasisField::get_size() const {
     return size_;
 }
 
 
-const double& BasisField::get_decay() const {
+const real& BasisField::get_decay() const {
     return decay_;
 }
 
 
-void BasisField::set_centre(DVector2 centre) {
+void BasisField::set_centre(RVector2 centre) {
     centre_ = centre;
 }
 
 
-void BasisField::set_size(double size) {
+void BasisField::set_size(real size) {
     size_ = size;
 }
 
 
-void BasisField::set_decay(double decay) {
+void BasisField::set_decay(real decay) {
     decay_ = decay;
 }
 
 
-Tensor BasisField::get_tensor(const DVector2& pos) const {
+Tensor BasisField::get_tensor(const RVector2& pos) const {
     return Tensor::degenerate();
 } 
 
 
-double BasisField::get_tensor_weight(const DVector2& pos) const {
-    if (size_ == 0) {
+real BasisField::tensor_weight(const RVector2& centre, real size,
+    real decay, const RVector2& pos)
+{
+    if (size == 0) {
         return 1;
     }
 
-    DVector2 from_centre = pos - centre_;
-    double norm_dist_to_centre =
-        std::hypot(from_centre.x, from_centre.y) / size_;
+    RVector2 from_centre = pos - centre;
+    real norm_dist_to_centre =
+        std::hypot(from_centre.x, from_centre.y) / size;
     
-    if (decay_ == 0 && norm_dist_to_centre >= 1 ) {
+    if (decay == 0 && norm_dist_to_centre >= 1 ) {
         return 0;
     }
     
-    double out = std::pow(
-        std::max(0.0, 1.0-norm_dist_to_centre),
-        decay_
+    real out = std::pow(
+        std::max(real(0), 1-norm_dist_to_centre),
+        decay
     );
 
     if (std::abs(out) < d_epsilon) {
@@ -163,26 +184,68 @@ double BasisField::get_tensor_weight(const DVector2& pos) const {
 }
 
 
-Tensor BasisField::get_weighted_tensor(const DVector2& pos) const {
+real BasisField::get_tensor_weight(const RVector2& pos) const {
+    return tensor_weight(centre_, size_, decay_, pos);
+}
+
+
+Tensor BasisField::get_weighted_tensor(const RVector2& pos) const {
     return get_tensor(pos)*get_tensor_weight(pos);
 }
 
 
+void BasisField::tensor_weights(const RVector2& centre, real size,
+    real decay, const real* xs, const real* ys,
+    real* weights, size_t n)
+{
+    if (size == 0) {
+        std::fill(weights, weights+n, real(1));
+        return;
+    }
+
+    real inv_size = 1/size;
+
+    for (size_t i=0; i<n; ++i) {
+        real dx = xs[i] - centre.x;
+        real dy = ys[i] - centre.y;
+        weights[i] = std::max(real(0), 1 - std::sqrt(dx*dx + dy*dy)*inv_size);
+    }
+
+    // pow does not vectorize, so the common decays get their own loops
+    if (decay == 0) {
+        for (size_t i=0; i<n; ++i) weights[i] = weights[i] > 0 ? real(1) : real(0);
+    } else if (decay == 2) {
+        for (size_t i=0; i<n; ++i) weights[i] *= weights[i];
+    } else if (decay != 1) {
+        for (size_t i=0; i<n; ++i) weights[i] = std::pow(weights[i], decay);
+    }
+
+    for (size_t i=0; i<n; ++i) {
+        weights[i] = weights[i] < d_epsilon ? real(0) : weights[i];
+    }
+}
+
+
 
 // ****** BasisField : Grid ******
-Grid::Grid(double _theta, DVector2 _centre) 
+Grid::Grid(real _theta, RVector2 _centre) 
     : BasisField(_centre), theta(_theta) {}
 
-Grid::Grid(double _theta, DVector2 _centre, double _size, double _decay) 
+Grid::Grid(real _theta, RVector2 _centre, real _size, real _decay) 
     : BasisField(_centre, _size, _decay), theta(_theta) {}
 
 
-void Grid::set_theta(double _theta) {
+void Grid::set_theta(real _theta) {
     theta = _theta;
 }
 
 
-Tensor Grid::get_tensor(const DVector2& pos) const {
+const real& Grid::get_theta() const {
+    return theta;
+}
+
+
+Tensor Grid::get_tensor(const RVector2& pos) const {
     return Tensor::from_r_theta(1, theta);
 }
 
@@ -190,104 +253,955 @@ Tensor Grid::get_tensor(const DVector2& pos) const {
 
 // ****** BasisField : Radial ******
 
-Radial::Radial(DVector2 _centre) 
+Radial::Radial(RVector2 _centre) 
     : BasisField(_centre) {}
 
-Radial::Radial(DVector2 _centre, double _size, double _decay) 
+Radial::Radial(RVector2 _centre, real _size, real _decay) 
     : BasisField(_centre, _size, _decay) {}
 
 
 
-Tensor Radial::get_tensor(const DVector2& pos) const {
+Tensor Radial::get_tensor(const RVector2& pos) const {
     return Tensor::from_xy(pos - centre_);
 }
 
 
-// ****** TensorField ******
+// ****** BasisField : Heightmap ******
 
+Heightmap::Heightmap(RVector2 _centre,
+        std::shared_ptr<const GradientRaster> _raster,
+        real _pixel_size, real _height)
+    : BasisField(_centre), raster_(std::move(_raster)),
+    pixel_size_(_pixel_size), height_(_height) {}
 
-TensorField::TensorField() {}
+Heightmap::Heightmap(RVector2 _centre, real _size, real _decay,
+        std::shared_ptr<const GradientRaster> _raster,
+        real _pixel_size, real _height)
+    : BasisField(_centre, _size, _decay), raster_(std::move(_raster)),
+    pixel_size_(_pixel_size), height_(_height) {}
 
 
-const DVector2& TensorField::get_centre(size_t idx) const {
-    return std::visit([](const auto& f) -> const DVector2& {
-            return f.get_centre();
-        },
-        basis_fields[idx]
-    );
+const std::shared_ptr<const GradientRaster>& Heightmap::get_raster() const {
+    return raster_;
 }
 
-const double& TensorField::get_size(size_t idx) const {
-    return std::visit([](const auto& f) -> const double& {
-            return f.get_size();
-        },
-        basis_fields[idx]
-    );
+
+const real& Heightmap::get_pixel_size() const {
+    return pixel_size_;
 }
 
-const double& TensorField::get_decay(size_t idx) const {
-    return std::visit([](const auto& f) -> const double& {
-            return f.get_decay();
-        },
-        basis_fields[idx]
-    );
+
+const real& Heightmap::get_height() const {
+    return height_;
 }
 
 
-void TensorField::set_centre(size_t idx, DVector2 centre) {
-    std::visit([&centre](auto& f) {
-            f.set_centre(centre);
-        },
-        basis_fields[idx]
-    );
+void Heightmap::set_raster(std::shared_ptr<const GradientRaster> raster) {
+    raster_ = std::move(raster);
+}
+
+
+void Heightmap::set_pixel_size(real pixel_size) {
+    pixel_size_ = pixel_size;
+}
+
+
+void Heightmap::set_height(real height) {
+    height_ = height;
 }
 
 
-void TensorField::set_size(size_t idx, double size) {
-    std::visit([&size](auto& f) {
-            f.set_size(size);
-        }, 
-        basis_fields[idx]
+RVector2 Heightmap::gradient(const GradientRaster& raster,
+    const RVector2& centre, real pixel_size, real height, const RVector2& pos)
+{
+    RVector2 px = (pos - centre)/pixel_size;
+
+    RVector2 g = raster.sample(
+        px.x + (raster.width()-1)*real(0.5),
+        px.y + (raster.height()-1)*real(0.5)
     );
+
+    return g*(height/pixel_size);
 }
 
 
-void TensorField::set_decay(size_t idx, double decay) {
-    std::visit([&decay](auto& f) {
-            f.set_decay(decay);
-        },
-        basis_fields[idx]
+RVector2 Heightmap::get_gradient(const RVector2& pos) const {
+    if (raster_ == nullptr) return {0, 0};
+    return gradient(*raster_, centre_, pixel_size_, height_, pos);
+}
+
+
+Tensor Heightmap::get_tensor(const RVector2& pos) const {
+    return Tensor::from_xy(get_gradient(pos));
+}
+
+
+// ****** BasisField : Noise ******
+
+Noise::Noise(RVector2 _centre, real _scale, real _angle, int _octaves) 
+    : BasisField(_centre), scale_(_scale), angle_(_angle), octaves_(_octaves) {}
+
+Noise::Noise(RVector2 _centre, real _size, real _decay,
+        real _scale, real _angle, int _octaves) 
+    : BasisField(_centre, _size, _decay),
+    scale_(_scale), angle_(_angle), octaves_(_octaves) {}
+
+
+const real& Noise::get_scale() const {
+    return scale_;
+}
+
+
+const real& Noise::get_angle() const {
+    return angle_;
+}
+
+
+const int& Noise::get_octaves() const {
+    return octaves_;
+}
+
+
+void Noise::set_scale(real scale) {
+    scale_ = scale;
+}
+
+
+void Noise::set_angle(real angle) {
+    angle_ = angle;
+}
+
+
+void Noise::set_octaves(int octaves) {
+    octaves_ = octaves;
+}
+
+
+real Noise::get_rotation(const RVector2& pos) const {
+    SimplexNoise noise;
+    return get_tensor_weight(pos)*angle_*noise.fractal(
+        octaves_,
+        static_cast<float>(pos.x/scale_),
+        static_cast<float>(pos.y/scale_)
     );
 }
 
 
+// ****** BasisColumns ******
+
+size_t BasisColumns::size() const {
+    return centres.size();
+}
+
+
+void BasisColumns::push(const BasisField& f) {
+    centres.push_back(f.get_centre());
+    sizes.push_back(f.get_size());
+    decays.push_back(f.get_decay());
+    index.insert(centres.size()-1, f.get_centre(), f.get_size());
+}
+
+
+void BasisColumns::load(size_t slot, BasisField& f) const {
+    f.set_centre(centres[slot]);
+    f.set_size(sizes[slot]);
+    f.set_decay(decays[slot]);
+}
+
+
+void BasisColumns::store(size_t slot, const BasisField& f) {
+    centres[slot] = f.get_centre();
+    sizes[slot] = f.get_size();
+    decays[slot] = f.get_decay();
+    reindex(slot);
+}
+
+
+void BasisColumns::erase(size_t slot) {
+    centres.erase(centres.begin() + slot);
+    sizes.erase(sizes.begin() + slot);
+    decays.erase(decays.begin() + slot);
+    rebuild_index(); // slots past the erased one shift down
+}
+
+
+void BasisColumns::clear() {
+    centres.clear();
+    sizes.clear();
+    decays.clear();
+    index.clear();
+}
+
+
+void BasisColumns::reindex(size_t slot) {
+    index.update(slot, centres[slot], sizes[slot]);
+}
+
+
+void BasisColumns::rebuild_index() {
+    index.clear();
+    for (size_t slot=0; slot<centres.size(); ++slot) {
+        index.insert(slot, centres[slot], sizes[slot]);
+    }
+}
+
+
+// ****** far field aggregates ******
+
+void GridFarField::add(real cos_2t, real sin_2t) {
+    a += cos_2t;
+    b += sin_2t;
+}
+
+
+void GridFarField::clear() {
+    *this = {};
+}
+
+
+void RadialFarField::add(const RVector2& centre) {
+    if (n == 0) origin = centre;
+
+    real ex = centre.x - origin.x;
+    real ey = centre.y - origin.y;
+
+    n += 1;
+    sx += ex;
+    sy += ey;
+    syy_xx += ey*ey - ex*ex;
+    sxy += ex*ey;
+}
+
+
+void RadialFarField::clear() {
+    *this = {};
+}
+
+
+// expands sum (dy^2 - dx^2, -2 dx dy) with d = p - c = q - e, q = p - origin
+void RadialFarField::accumulate(real px, real py, real& a, real& b) const {
+    real qx = px - origin.x;
+    real qy = py - origin.y;
+
+    a += n*(qy*qy - qx*qx) - 2*qy*sy + 2*qx*sx + syy_xx;
+    b += -2*(n*qx*qy - qx*sy - qy*sx + sxy);
+}
+
+
+// ****** BasisStore<Grid> ******
+
+void BasisStore<Grid>::push(const Grid& f) {
+    BasisColumns::push(f);
+    thetas.push_back(f.get_theta());
+    cos_2t.push_back(std::cos(2*f.get_theta()));
+    sin_2t.push_back(std::sin(2*f.get_theta()));
+
+    if (f.get_size() <= 0) far_field.add(cos_2t.back(), sin_2t.back());
+}
+
+
+Grid BasisStore<Grid>::load(size_t slot) const {
+    return Grid(thetas[slot], centres[slot], sizes[slot], decays[slot]);
+}
+
+
+void BasisStore<Grid>::store(size_t slot, const Grid& f) {
+    BasisColumns::store(slot, f);
+    thetas[slot] = f.get_theta();
+    cos_2t[slot] = std::cos(2*f.get_theta());
+    sin_2t[slot] = std::sin(2*f.get_theta());
+    refresh_far_field();
+}
+
+
+void BasisStore<Grid>::erase(size_t slot) {
+    BasisColumns::erase(slot);
+    thetas.erase(thetas.begin() + slot);
+    cos_2t.erase(cos_2t.begin() + slot);
+    sin_2t.erase(sin_2t.begin() + slot);
+    refresh_far_field();
+}
+
+
+void BasisStore<Grid>::clear() {
+    BasisColumns::clear();
+    thetas.clear();
+    cos_2t.clear();
+    sin_2t.clear();
+    far_field.clear();
+}
+
+
+void BasisStore<Grid>::refresh_far_field() {
+    far_field.clear();
+    for (std::uint32_t s : index.global()) far_field.add(cos_2t[s], sin_2t[s]);
+}
+
+
+void BasisStore<Grid>::accumulate(const RVector2& pos,
+    real& a, real& b) const 
+{
+    a += far_field.a;
+    b += far_field.b;
+
+    index.for_each_at(pos, [&](std::uint32_t s) {
+        real w = BasisField::tensor_weight(centres[s], sizes[s], decays[s], pos);
+        a += w*cos_2t[s];
+        b += w*sin_2t[s];
+    }, false);
+}
+
+
+void BasisStore<Grid>::accumulate_batch(const real* xs, const real* ys,
+    const RVector2& lo, const RVector2& hi, size_t n,
+    real* weights, std::vector<std::uint32_t>& scratch,
+    real* a, real* b) const
+{
+    for (size_t i=0; i<n; ++i) {
+        a[i] += far_field.a;
+        b[i] += far_field.b;
+    }
+
+    index.for_each_in(lo, hi, scratch, [&](std::uint32_t s) {
+        BasisField::tensor_weights(centres[s], sizes[s], decays[s],
+            xs, ys, weights, n);
+
+        const real ca = cos_2t[s];
+        const real cb = sin_2t[s];
+
+        for (size_t i=0; i<n; ++i) {
+            a[i] += weights[i]*ca;
+            b[i] += weights[i]*cb;
+        }
+    }, false);
+}
+
+
+// ****** BasisStore<Radial> ******
+
+void BasisStore<Radial>::push(const Radial& f) {
+    BasisColumns::push(f);
+    if (f.get_size() <= 0) far_field.add(f.get_centre());
+}
+
+
+Radial BasisStore<Radial>::load(size_t slot) const {
+    return Radial(centres[slot], sizes[slot], decays[slot]);
+}
+
+
+void BasisStore<Radial>::store(size_t slot, const Radial& f) {
+    BasisColumns::store(slot, f);
+    refresh_far_field();
+}
+
+
+void BasisStore<Radial>::erase(size_t slot) {
+    BasisColumns::erase(slot);
+    refresh_far_field();
+}
+
+
+void BasisStore<Radial>::clear() {
+    BasisColumns::clear();
+    far_field.clear();
+}
+
+
+void BasisStore<Radial>::refresh_far_field() {
+    far_field.clear();
+    for (std::uint32_t s : index.global()) far_field.add(centres[s]);
+}
+
+
+void BasisStore<Radial>::accumulate(const RVector2& pos,
+    real& a, real& b) const 
+{
+    if (far_field.n > 0) far_field.accumulate(pos.x, pos.y, a, b);
+
+    index.for_each_at(pos, [&](std::uint32_t s) {
+        real w = BasisField::tensor_weight(centres[s], sizes[s], decays[s], pos);
+        real dx = pos.x - centres[s].x;
+        real dy = pos.y - centres[s].y;
+
+        a += w*(dy*dy - dx*dx);
+        b += w*(-2*dx*dy);
+    }, false);
+}
+
+
+void BasisStore<Radial>::accumulate_batch(const real* xs, const real* ys,
+    const RVector2& lo, const RVector2& hi, size_t n,
+    real* weights, std::vector<std::uint32_t>& scratch,
+    real* a, real* b) const
+{
+    if (far_field.n > 0) {
+        for (size_t i=0; i<n; ++i) {
+            far_field.accumulate(xs[i], ys[i], a[i], b[i]);
+        }
+    }
+
+    index.for_each_in(lo, hi, scratch, [&](std::uint32_t s) {
+        BasisField::tensor_weights(centres[s], sizes[s], decays[s],
+            xs, ys, weights, n);
+
+        const real cx = centres[s].x;
+        const real cy = centres[s].y;
+
+        for (size_t i=0; i<n; ++i) {
+            real dx = xs[i] - cx;
+            real dy = ys[i] - cy;
+
+            a[i] += weights[i]*(dy*dy - dx*dx);
+            b[i] += weights[i]*(-2*dx*dy);
+        }
+    }, false);
+}
+
+
+// ****** BasisStore<Heightmap> ******
+
+void BasisStore<Heightmap>::push(const Heightmap& f) {
+    BasisColumns::push(f);
+    rasters.push_back(f.get_raster());
+    pixel_sizes.push_back(f.get_pixel_size());
+    heights.push_back(f.get_height());
+}
+
+
+Heightmap BasisStore<Heightmap>::load(size_t slot) const {
+    return Heightmap(centres[slot], sizes[slot], decays[slot],
+        rasters[slot], pixel_sizes[slot], heights[slot]);
+}
+
+
+void BasisStore<Heightmap>::store(size_t slot, const Heightmap& f) {
+    BasisColumns::store(slot, f);
+    rasters[slot] = f.get_raster();
+    pixel_sizes[slot] = f.get_pixel_size();
+    heights[slot] = f.get_height();
+}
+
+
+void BasisStore<Heightmap>::erase(size_t slot) {
+    BasisColumns::erase(slot);
+    rasters.erase(rasters.begin() + slot);
+    pixel_sizes.erase(pixel_sizes.begin() + slot);
+    heights.erase(heights.begin() + slot);
+}
+
+
+void BasisStore<Heightmap>::clear() {
+    BasisColumns::clear();
+    rasters.clear();
+    pixel_sizes.clear();
+    heights.clear();
+}
+
+
+void BasisStore<Heightmap>::accumulate(const RVector2& pos,
+    real& a, real& b) const 
+{
+    index.for_each_at(pos, [&](std::uint32_t s) {
+        if (rasters[s] == nullptr) return;
+
+        real w = BasisField::tensor_weight(centres[s], sizes[s], decays[s], pos);
+        if (w == 0.0) return;
+
+        RVector2 g = Heightmap::gradient(*rasters[s], centres[s],
+            pixel_sizes[s], heights[s], pos);
+
+        a += w*(g.y*g.y - g.x*g.x);
+        b += w*(-2*g.x*g.y);
+    });
+}
+
+
+void BasisStore<Heightmap>::accumulate_batch(const real* xs, const real* ys,
+    const RVector2& lo, const RVector2& hi, size_t n,
+    real* weights, std::vector<std::uint32_t>& scratch,
+    real* a, real* b) const
+{
+    index.for_each_in(lo, hi, scratch, [&](std::uint32_t s) {
+        if (rasters[s] == nullptr) return;
+
+        BasisField::tensor_weights(centres[s], sizes[s], decays[s],
+            xs, ys, weights, n);
+
+        for (size_t i=0; i<n; ++i) {
+            if (weights[i] == 0.0) continue;
+
+            RVector2 g = Heightmap::gradient(*rasters[s], centres[s],
+                pixel_sizes[s], heights[s], {xs[i], ys[i]});
+
+            a[i] += weights[i]*(g.y*g.y - g.x*g.x);
+            b[i] += weights[i]*(-2*g.x*g.y);
+        }
+    });
+}
+
+
+// ****** BasisStore<Noise> ******
+
+void BasisStore<Noise>::push(const Noise& f) {
+    BasisColumns::push(f);
+    scales.push_back(f.get_scale());
+    angles.push_back(f.get_angle());
+    octaves.push_back(f.get_octaves());
+}
+
+
+Noise BasisStore<Noise>::load(size_t slot) const {
+    return Noise(centres[slot], sizes[slot], decays[slot],
+        scales[slot], angles[slot], octaves[slot]);
+}
+
+
+void BasisStore<Noise>::store(size_t slot, const Noise& f) {
+    BasisColumns::store(slot, f);
+    scales[slot] = f.get_scale();
+    angles[slot] = f.get_angle();
+    octaves[slot] = f.get_octaves();
+}
+
+
+void BasisStore<Noise>::erase(size_t slot) {
+    BasisColumns::erase(slot);
+    scales.erase(scales.begin() + slot);
+    angles.erase(angles.begin() + slot);
+    octaves.erase(octaves.begin() + slot);
+}
+
+
+void BasisStore<Noise>::clear() {
+    BasisColumns::clear();
+    scales.clear();
+    angles.clear();
+    octaves.clear();
+}
+
+
+void BasisStore<Noise>::accumulate(const RVector2& pos,
+    real& a, real& b) const 
+{
+    real angle = 0.0;
+
+    index.for_each_at(pos, [&](std::uint32_t s) {
+        real w = BasisField::tensor_weight(centres[s], sizes[s], decays[s], pos);
+        if (w == 0.0) return;
+
+        angle += w*angles[s]*tiles->sample(
+            octaves[s], (pos.x + origin.x)/scales[s], (pos.y + origin.y)/scales[s]
+        );
+    });
+
+    if (angle == 0.0) return;
+
+    Tensor rotated = Tensor::from_a_b(a, b).rotate(angle);
+    a = rotated.a;
+    b = rotated.b;
+}
+
+
+void BasisStore<Noise>::accumulate_batch(const real* xs, const real* ys,
+    const RVector2& lo, const RVector2& hi, size_t n,
+    real* weights, std::vector<std::uint32_t>& scratch,
+    real* a, real* b) const
+{
+    index.for_each_in(lo, hi, scratch, [&](std::uint32_t s) {
+        BasisField::tensor_weights(centres[s], sizes[s], decays[s],
+            xs, ys, weights, n);
+
+        real inv_scale = 1/scales[s];
+
+        for (size_t i=0; i<n; ++i) {
+            if (weights[i] == 0.0) continue;
+
+            real angle = weights[i]*angles[s]*tiles->sample(
+                octaves[s], (xs[i] + origin.x)*inv_scale, (ys[i] + origin.y)*inv_scale
+            );
+
+            Tensor rotated = Tensor::from_a_b(a[i], b[i]).rotate(angle);
+            a[i] = rotated.a;
+            b[i] = rotated.b;
+        }
+    });
+}
+
+
+// ****** TensorField ******
+
+
+TensorField::TensorField() {}
+
+
+BasisColumns& TensorField::columns(BasisKind kind) {
+    return const_cast<BasisColumns&>(std::as_const(*this).columns(kind));
+}
+
+
+const BasisColumns& TensorField::columns(BasisKind kind) const {
+    const BasisColumns* out = nullptr;
+
+    std::apply([&out, kind](const auto&... store) {
+        ((store.kind == kind ? out = &store : out), ...);
+    }, stores_);
+
+    assert(out != nullptr);
+    return *out;
+}
+
+
+void TensorField::refresh_far_field(BasisKind kind) {
+    std::apply([kind](auto&... store) {
+        auto refresh = [kind](auto& st) {
+            if constexpr (requires { st.refresh_far_field(); }) {
+                if (st.kind == kind) st.refresh_far_field();
+            }
+        };
+        (refresh(store), ...);
+    }, stores_);
+}
+
+
+const RVector2& TensorField::get_centre(size_t idx) const {
+    const Slot& s = slots_[idx];
+    return columns(s.kind).centres[s.slot];
+}
+
+const real& TensorField::get_size(size_t idx) const {
+    const Slot& s = slots_[idx];
+    return columns(s.kind).sizes[s.slot];
+}
+
+const real& TensorField::get_decay(size_t idx) const {
+    const Slot& s = slots_[idx];
+    return columns(s.kind).decays[s.slot];
+}
+
+
+Box<real> TensorField::influence(size_t idx) const {
+    const real& size = get_size(idx);
+    if (size <= 0) return everywhere();
+
+    const RVector2& centre = get_centre(idx);
+    RVector2 half_diag = {size, size};
+
+    return Box(centre - half_diag, centre + half_diag);
+}
+
+
+void TensorField::mark_dirty(const Box<real>& bbox) {
+    dirty_log_.push_back({version_, bbox});
+
+    while (dirty_log_.size() > kDirtyLogCapacity) {
+        dirty_floor_ = dirty_log_.front().version;
+        dirty_log_.pop_front();
+    }
+}
+
+
+void TensorField::set_centre(size_t idx, RVector2 centre) {
+    ++version_;
+    mark_dirty(influence(idx));
+
+    const Slot& s = slots_[idx];
+    BasisColumns& cols = columns(s.kind);
+
+    cols.centres[s.slot] = centre;
+    cols.reindex(s.slot);
+    refresh_far_field(s.kind);
+    mark_dirty(influence(idx));
+}
+
+
+void TensorField::set_size(size_t idx, real size) {
+    ++version_;
+    mark_dirty(influence(idx));
+
+    const Slot& s = slots_[idx];
+    BasisColumns& cols = columns(s.kind);
+
+    cols.sizes[s.slot] = size;
+    cols.reindex(s.slot);
+    refresh_far_field(s.kind);
+    mark_dirty(influence(idx));
+}
+
+
+void TensorField::set_decay(size_t idx, real decay) {
+    ++version_;
+    mark_dirty(influence(idx));
+
+    const Slot& s = slots_[idx];
+    columns(s.kind).decays[s.slot] = decay;
+}
+
+
 void TensorField::erase(size_t idx) {
-    basis_fields.erase(basis_fields.begin() + idx);
+    ++version_;
+    mark_dirty(influence(idx));
+
+    Slot removed = slots_[idx];
+
+    std::apply([&removed](auto&... store) {
+        ((store.kind == removed.kind ? store.erase(removed.slot) : void()), ...);
+    }, stores_);
+
+    slots_.erase(slots_.begin() + idx);
+
+    for (Slot& s : slots_) {
+        if (s.kind == removed.kind && s.slot > removed.slot) --s.slot;
+    }
+}
+
+
+Tensor TensorField::sample(const RVector2& pos) const {
+    real a = 0.0;
+    real b = 0.0;
+
+    std::apply([&](const auto&... store) {
+        (store.accumulate(pos, a, b), ...);
+    }, stores_);
+
+    return Tensor::from_a_b(a, b);
+}
+
+
+void TensorField::sample_batch(
+    std::span<const real> xs,
+    std::span<const real> ys,
+    std::span<real> a,
+    std::span<real> b,
+    std::span<RVector2> major,
+    std::span<RVector2> minor
+) const {
+    const size_t n = xs.size();
+    assert(ys.size() == n && a.size() == n && b.size() == n);
+    assert(major.size() == n && minor.size() == n);
+
+    std::fill(a.begin(), a.end(), real(0));
+    std::fill(b.begin(), b.end(), real(0));
+
+    real weights[kBatchChunk];
+    std::vector<std::uint32_t> scratch;
+
+    // chunk the positions so weights stay in L1 while every field is summed
+    for (size_t begin=0; begin<n; begin+=kBatchChunk) {
+        size_t m = std::min(kBatchChunk, n-begin);
+
+        const real* cx = xs.data() + begin;
+        const real* cy = ys.data() + begin;
+        real* ca = a.data() + begin;
+        real* cb = b.data() + begin;
+
+        auto [min_x, max_x] = std::minmax_element(cx, cx+m);
+        auto [min_y, max_y] = std::minmax_element(cy, cy+m);
+        RVector2 lo = {*min_x, *min_y};
+        RVector2 hi = {*max_x, *max_y};
+
+        std::apply([&](const auto&... store) {
+            (store.accumulate_batch(cx, cy, lo, hi, m, weights, scratch, ca, cb), ...);
+        }, stores_);
+    }
+
+    // eigenvectors via half angle identities, keeps the loop free of trig
+    for (size_t i=0; i<n; ++i) {
+        real r = std::sqrt(a[i]*a[i] + b[i]*b[i]);
+        bool degenerate = r <= d_epsilon;
+
+        RVector2 e = Tensor::half_angle(a[i], b[i], degenerate ? real(1) : r);
+
+        real scale = degenerate ? real(0) : real(1);
+        major[i] = {scale*e.x, scale*e.y};
+        minor[i] = {scale*e.y, -scale*e.x};
+    }
+}
+
+
+// relative to the corner values, below it a component is rounding noise
+static constexpr real kZeroTolerance = 16*d_epsilon;
+
+
+// zero of the linear interpolant of (a, b) over triangle p0 p1 p2, if any
+static std::optional<RVector2> triangle_zero(
+    const RVector2& p0, const RVector2& p1, const RVector2& p2,
+    real a0, real a1, real a2, real b0, real b1, real b2)
+{
+    real ea1 = a1-a0, ea2 = a2-a0;
+    real eb1 = b1-b0, eb2 = b2-b0;
+
+    real scale = std::max({std::abs(a0), std::abs(a1), std::abs(a2)})
+        *std::max({std::abs(b0), std::abs(b1), std::abs(b2)});
+
+    real det = ea1*eb2 - ea2*eb1;
+    if (std::abs(det) <= kZeroTolerance*scale) return {};
+
+    real l1 = (-a0*eb2 + b0*ea2)/det;
+    real l2 = (-b0*ea1 + a0*eb1)/det;
+
+    if (l1 < 0 || l2 < 0 || l1 + l2 > 1) return {};
+
+    return p0 + (p1-p0)*l1 + (p2-p0)*l2;
 }
 
 
-Tensor TensorField::sample(const DVector2& pos) const {
-    Tensor total;
+// where one component vanishes over a whole cell, the other's zero line
+// runs through it. the centre of its crossings of the cell's edges, p and
+// v in order around the cell, stands in for the degenerate point.
+static std::optional<RVector2> boundary_zero(const RVector2 (&p)[4], const real (&v)[4]) {
+    RVector2 sum;
+    int crossings = 0;
+
+    for (int i=0; i<4; ++i) {
+        int k = (i + 1)%4;
+        if ((v[i] > 0) == (v[k] > 0)) continue;
 
-    for (auto& x : basis_fields) {
-        std::visit([&total, &pos](const auto& f) {
-            total = total + f.get_weighted_tensor(pos);
-        }, x);
+        sum = sum + p[i] + (p[k] - p[i])*(v[i]/(v[i] - v[k]));
+        ++crossings;
     }
 
-    total.set_r_theta();
+    if (crossings == 0) return {};
+    return sum/static_cast<real>(crossings);
+}
+
+
+std::vector<RVector2>
+TensorField::degenerate_points(const Box<real>& region, real cell) const {
+    assert(cell > 0);
+
+    std::vector<RVector2> out;
+    if (!(region.width() > 0) || !(region.height() > 0)) return out;
+
+    int cols = static_cast<int>(std::ceil(region.width()/cell)) + 1;
+    int rows = static_cast<int>(std::ceil(region.height()/cell)) + 1;
+    size_t n = static_cast<size_t>(cols)*rows;
+
+    std::vector<real> xs(n), ys(n), a(n), b(n);
+    std::vector<RVector2> major(n), minor(n);
+
+    for (int j=0; j<rows; ++j) {
+        for (int i=0; i<cols; ++i) {
+            xs[j*cols + i] = region.min.x + i*cell;
+            ys[j*cols + i] = region.min.y + j*cell;
+        }
+    }
+
+    sample_batch(xs, ys, a, b, major, minor);
+
+    auto same_sign = [](real v0, real v1, real v2, real v3) {
+        return (v0 > 0 && v1 > 0 && v2 > 0 && v3 > 0)
+            || (v0 < 0 && v1 < 0 && v2 < 0 && v3 < 0);
+    };
 
-    return total;
+    for (int j=0; j+1<rows; ++j) {
+        for (int i=0; i+1<cols; ++i) {
+            size_t i00 = j*cols + i;
+            size_t i10 = i00 + 1;
+            size_t i01 = i00 + cols;
+            size_t i11 = i01 + 1;
+
+            RVector2 p00 = {xs[i00], ys[i00]};
+            RVector2 p10 = {xs[i10], ys[i10]};
+            RVector2 p01 = {xs[i01], ys[i01]};
+            RVector2 p11 = {xs[i11], ys[i11]};
+
+            // a component that vanishes at every corner leaves no sign
+            // change to find, nor a triangle to solve. one centred on the
+            // cell, as a Radial is on its diagonals, is caught here.
+            real a_max = std::max({std::abs(a[i00]), std::abs(a[i10]),
+                std::abs(a[i01]), std::abs(a[i11])});
+            real b_max = std::max({std::abs(b[i00]), std::abs(b[i10]),
+                std::abs(b[i01]), std::abs(b[i11])});
+
+            if (a_max <= kZeroTolerance*b_max || b_max <= kZeroTolerance*a_max) {
+                const real* rest = a_max <= kZeroTolerance*b_max ? b.data() : a.data();
+
+                auto zero = boundary_zero({p00, p10, p11, p01},
+                    {rest[i00], rest[i10], rest[i11], rest[i01]});
+
+                if (zero.has_value() && region.contains(zero.value()))
+                    out.push_back(zero.value());
+                continue;
+            }
+
+            // both components have to change sign for a common zero
+            if (same_sign(a[i00], a[i10], a[i01], a[i11])) continue;
+            if (same_sign(b[i00], b[i10], b[i01], b[i11])) continue;
+
+            auto zero = triangle_zero(p00, p10, p11,
+                a[i00], a[i10], a[i11], b[i00], b[i10], b[i11]);
+
+            if (!zero.has_value()) {
+                zero = triangle_zero(p00, p11, p01,
+                    a[i00], a[i11], a[i01], b[i00], b[i11], b[i01]);
+            }
+
+            if (zero.has_value() && region.contains(zero.value()))
+                out.push_back(zero.value());
+        }
+    }
+
+    return out;
 }
 
 
 size_t TensorField::size() const {
-    return basis_fields.size();
+    return slots_.size();
+}
+
+
+std::uint64_t TensorField::version() const {
+    return version_;
 }
 
 
 void TensorField::clear() {
-    basis_fields.clear();
+    ++version_;
+    mark_dirty(everywhere());
+    slots_.clear();
+
+    std::apply([](auto&... store) {
+        (store.clear(), ...);
+    }, stores_);
+}
+
+
+void TensorField::move_origin(const RVector2& origin) {
+    ++version_;
+    mark_dirty(everywhere());
+
+    std::apply([&origin](auto&... store) {
+        auto move = [&origin](auto& st) {
+            for (RVector2& centre : st.centres) centre = centre - origin;
+            st.rebuild_index();
+
+            if constexpr (requires { st.refresh_far_field(); }) st.refresh_far_field();
+        };
+        (move(store), ...);
+    }, stores_);
+
+    BasisStore<Noise>& noise = std::get<BasisStore<Noise>>(stores_);
+    noise.origin = noise.origin + origin;
 }
 
 
+std::optional<std::vector<Box<real>>>
+TensorField::dirty_since(std::uint64_t version) const {
+    if (version < dirty_floor_) return {};
+
+    std::vector<Box<real>> out;
+
+    for (auto it = dirty_log_.rbegin(); it != dirty_log_.rend(); ++it) {
+        if (it->version <= version) break;
+        out.push_back(it->bbox);
+    }
+
+    return out;
+}
+
+
+Box<real> TensorField::everywhere() {
+    constexpr real inf = Box<real>::inf;
+    return Box<real>({-inf, -inf}, {inf, inf});
+}
@@ -1,149 +1,481 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <limits>
+#include <optional>
+#include <memory>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <vector>
 
 #include "../types.h"
+#include "field_index.h"
+#include "gradient_raster.h"
+#include "noise_tiles.h"
 
-static constexpr double d_epsilon = std::numeric_limits<double>::epsilon();
+static constexpr real d_epsilon = std::numeric_limits<real>::epsilon();
 
 struct Tensor {
     // 2x2 symmetric, traceless matrix represented as
     // R * | cos(2θ)  sin(2θ) | --> | a  b |
     //     | sin(2θ) -cos(2θ) |     | _  _ |
-    double a;
-    double b;
-    double r;
-    double theta;
+    // only (a, b) are stored; R and θ are derived on request, eigenvectors
+    // come straight from (a, b) without trig.
+    real a;
+    real b;
 
     static Tensor degenerate();
-    static Tensor from_a_b(const double& a, const double& b);
-    static Tensor from_r_theta(const double& r, const double& theta);
-    static Tensor from_xy(const DVector2& xy);
+    static Tensor from_a_b(const real& a, const real& b);
+    static Tensor from_r_theta(const real& r, const real& theta);
+    static Tensor from_xy(const RVector2& xy);
 
-    void set_r_theta();
+    // (cos θ, sin θ) given r = |(a, b)| > 0
+    static RVector2 half_angle(const real& a, const real& b, const real& r);
+
+    real get_r() const;
+    real get_theta() const;
 
     bool is_degenerate() const;
-    DVector2 get_major_eigenvector() const;
-    DVector2 get_minor_eigenvector() const;
+    RVector2 get_major_eigenvector() const;
+    RVector2 get_minor_eigenvector() const;
 
-    Tensor rotate(const double& angle) const;
+    Tensor rotate(const real& angle) const;
 
     Tensor operator+(const Tensor& other) const;
 
     // right scalar mult
-    Tensor operator*(const double& right) const;
+    Tensor operator*(const real& right) const;
 
 
     // left scalar mult
-    friend Tensor operator*(const double& left, const Tensor& right);
+    friend Tensor operator*(const real& left, const Tensor& right);
 };
 
 
 class BasisField {
     protected:
-        DVector2 centre_;
-        double size_;
-        double decay_;
+        RVector2 centre_;
+        real size_;
+        real decay_;
 
-        virtual Tensor get_tensor(const DVector2& pos) const;
-        double get_tensor_weight(const DVector2& pos) const;
+        virtual Tensor get_tensor(const RVector2& pos) const;
+        real get_tensor_weight(const RVector2& pos) const;
 
     public:
-        BasisField(DVector2 centre);
-        BasisField(DVector2 centre, double size, double decay);
+        BasisField(RVector2 centre);
+        BasisField(RVector2 centre, real size, real decay);
         virtual ~BasisField() = default;
 
-        const DVector2& get_centre() const;
-        const double& get_size() const;
-        const double& get_decay() const;
+        const RVector2& get_centre() const;
+        const real& get_size() const;
+        const real& get_decay() const;
+
+        void set_centre(RVector2 centre);
+        void set_size(real size);
+        void set_decay(real decay);
+
 
-        void set_centre(DVector2 centre);
-        void set_size(double size);
-        void set_decay(double decay);
+        Tensor get_weighted_tensor(const RVector2& pos) const;
 
+        static real tensor_weight(const RVector2& centre, real size,
+            real decay, const RVector2& pos);
 
-        Tensor get_weighted_tensor(const DVector2& pos) const;
+        // batch kernel over n contiguous positions, written branch-free so
+        // the compiler can vectorize it
+        static void tensor_weights(const RVector2& centre, real size,
+            real decay, const real* xs, const real* ys,
+            real* weights, size_t n);
 };
 
 
 class Grid : public BasisField {
     private:
-        double theta;
+        real theta;
 
 
     public:
-        Grid(double theta, DVector2 centre);
-        Grid(double theta, DVector2 centre, double size, double decay);
+        Grid(real theta, RVector2 centre);
+        Grid(real theta, RVector2 centre, real size, real decay);
 
-        Tensor get_tensor(const DVector2& pos) const override;
-        void set_theta(double _theta);
+        Tensor get_tensor(const RVector2& pos) const override;
+        void set_theta(real _theta);
+        const real& get_theta() const;
 };
 
 
 class Radial : public BasisField {
     public:
-        Radial(DVector2 centre);
-        Radial(DVector2 centre, double size, double decay);
+        Radial(RVector2 centre);
+        Radial(RVector2 centre, real size, real decay);
+
+        Tensor get_tensor(const RVector2& pos) const override;
+};
+
+
+// follows the contours of a heightmap: the tensor is Radial's built from
+// the terrain gradient instead of the offset from the centre, so it runs
+// across the slope and grows with steepness. the image is centred on
+// centre_ and contributes nothing outside it.
+class Heightmap : public BasisField {
+    private:
+        std::shared_ptr<const GradientRaster> raster_;
+        real pixel_size_; // world units per heightmap pixel
+        real height_;     // world height of a white pixel
+
+    public:
+        Heightmap(RVector2 centre, std::shared_ptr<const GradientRaster> raster,
+            real pixel_size, real height);
+        Heightmap(RVector2 centre, real size, real decay,
+            std::shared_ptr<const GradientRaster> raster,
+            real pixel_size, real height);
+
+        const std::shared_ptr<const GradientRaster>& get_raster() const;
+        const real& get_pixel_size() const;
+        const real& get_height() const;
+
+        void set_raster(std::shared_ptr<const GradientRaster> raster);
+        void set_pixel_size(real pixel_size);
+        void set_height(real height);
+
+        // world height per world unit
+        RVector2 get_gradient(const RVector2& pos) const;
+        Tensor get_tensor(const RVector2& pos) const override;
+
+        static RVector2 gradient(const GradientRaster& raster,
+            const RVector2& centre, real pixel_size, real height,
+            const RVector2& pos);
+};
+
+
+// adds nothing to the sum, instead rotates the summed tensor by
+// weight * angle * noise(pos/scale), with noise in [-1, 1]
+class Noise : public BasisField {
+    private:
+        real scale_; // world units per noise unit
+        real angle_; // largest rotation, radians
+        int octaves_;
+
+    public:
+        Noise(RVector2 centre, real scale, real angle, int octaves = 1);
+        Noise(RVector2 centre, real size, real decay,
+            real scale, real angle, int octaves = 1);
+
+        const real& get_scale() const;
+        const real& get_angle() const;
+        const int& get_octaves() const;
+
+        void set_scale(real scale);
+        void set_angle(real angle);
+        void set_octaves(int octaves);
+
+        // the exact rotation at pos, the simplex noise evaluated afresh. a
+        // TensorField samples its baked NoiseTiles instead, which differ
+        // from this by their interpolation error, so this is the reference
+        // for them rather than what the roads follow.
+        real get_rotation(const RVector2& pos) const;
+};
+
+
+// ****** basis field storage ******
+// TensorField keeps each kind of basis field in its own set of columns, so
+// sampling is a tight loop per kind rather than a dispatch per field.
+// Grid/Radial objects are only materialised for editing.
+
+enum class BasisKind : std::uint8_t {
+    Grid,
+    Radial,
+    Heightmap,
+    Noise
+};
+
+
+struct BasisColumns {
+    static constexpr real kIndexCellSize = 128.0;
+
+    std::vector<RVector2> centres;
+    std::vector<real> sizes;
+    std::vector<real> decays;
+    BasisFieldIndex index{kIndexCellSize}; // keyed by slot
+
+    size_t size() const;
+
+    void push(const BasisField& f);
+    void load(size_t slot, BasisField& f) const;
+    void store(size_t slot, const BasisField& f);
+    void erase(size_t slot);
+    void clear();
+
+    void reindex(size_t slot);
+    void rebuild_index();
+};
+
+
+// size 0 fields have weight 1 everywhere, so their sum has a closed form
+// and need not be evaluated field by field: grids add up to a constant
+// tensor, radials to a quadratic in the sample position.
+struct GridFarField {
+    real a = 0;
+    real b = 0;
+
+    void add(real cos_2t, real sin_2t);
+    void clear();
+};
+
+
+// moments of the radial centres about the first one added, which keeps
+// the terms small and avoids cancellation far from the world origin
+struct RadialFarField {
+    RVector2 origin;
+    real n = 0;
+    real sx = 0;     // sum of ex, e = centre - origin
+    real sy = 0;     // sum of ey
+    real syy_xx = 0; // sum of ey^2 - ex^2
+    real sxy = 0;    // sum of ex*ey
+
+    void add(const RVector2& centre);
+    void clear();
+
+    void accumulate(real px, real py, real& a, real& b) const;
+};
+
+
+template<typename V>
+struct BasisStore;
+
 
-        Tensor get_tensor(const DVector2& pos) const override;
+template<>
+struct BasisStore<Grid> : BasisColumns {
+    static constexpr BasisKind kind = BasisKind::Grid;
+
+    std::vector<real> thetas;
+    std::vector<real> cos_2t; // tensor components, fixed per grid
+    std::vector<real> sin_2t;
+    GridFarField far_field;   // all size 0 grids, skipped by the index
+
+    void push(const Grid& f);
+    Grid load(size_t slot) const;
+    void store(size_t slot, const Grid& f);
+    void erase(size_t slot);
+    void clear();
+    void refresh_far_field();
+
+    void accumulate(const RVector2& pos, real& a, real& b) const;
+    void accumulate_batch(const real* xs, const real* ys,
+        const RVector2& lo, const RVector2& hi, size_t n,
+        real* weights, std::vector<std::uint32_t>& scratch,
+        real* a, real* b) const;
+};
+
+
+template<>
+struct BasisStore<Radial> : BasisColumns {
+    static constexpr BasisKind kind = BasisKind::Radial;
+
+    RadialFarField far_field; // all size 0 radials, skipped by the index
+
+    void push(const Radial& f);
+    Radial load(size_t slot) const;
+    void store(size_t slot, const Radial& f);
+    void erase(size_t slot);
+    void clear();
+    void refresh_far_field();
+
+    void accumulate(const RVector2& pos, real& a, real& b) const;
+    void accumulate_batch(const real* xs, const real* ys,
+        const RVector2& lo, const RVector2& hi, size_t n,
+        real* weights, std::vector<std::uint32_t>& scratch,
+        real* a, real* b) const;
+};
+
+
+template<>
+struct BasisStore<Heightmap> : BasisColumns {
+    static constexpr BasisKind kind = BasisKind::Heightmap;
+
+    std::vector<std::shared_ptr<const GradientRaster>> rasters;
+    std::vector<real> pixel_sizes;
+    std::vector<real> heights;
+
+    void push(const Heightmap& f);
+    Heightmap load(size_t slot) const;
+    void store(size_t slot, const Heightmap& f);
+    void erase(size_t slot);
+    void clear();
+
+    void accumulate(const RVector2& pos, real& a, real& b) const;
+    void accumulate_batch(const real* xs, const real* ys,
+        const RVector2& lo, const RVector2& hi, size_t n,
+        real* weights, std::vector<std::uint32_t>& scratch,
+        real* a, real* b) const;
+};
+
+
+template<>
+struct BasisStore<Noise> : BasisColumns {
+    static constexpr BasisKind kind = BasisKind::Noise;
+
+    std::vector<real> scales;
+    std::vector<real> angles;
+    std::vector<int> octaves;
+
+    // noise content never changes, so copies of the field share one cache
+    std::shared_ptr<NoiseTiles> tiles = std::make_shared<NoiseTiles>();
+    RVector2 origin = {0, 0}; // added to positions, see TensorField::move_origin
+
+    void push(const Noise& f);
+    Noise load(size_t slot) const;
+    void store(size_t slot, const Noise& f);
+    void erase(size_t slot);
+    void clear();
+
+    // rotates the sum accumulated so far, so must run after additive kinds
+    void accumulate(const RVector2& pos, real& a, real& b) const;
+    void accumulate_batch(const real* xs, const real* ys,
+        const RVector2& lo, const RVector2& hi, size_t n,
+        real* weights, std::vector<std::uint32_t>& scratch,
+        real* a, real* b) const;
 };
 
 
 class TensorField {
 private:
-    std::vector<std::variant<Grid, Radial>> basis_fields;
+    static constexpr size_t kBatchChunk = 64;
+
+    struct Slot {
+        BasisKind kind;
+        std::uint32_t slot; // position within its kind's columns
+    };
+
+    static constexpr size_t kDirtyLogCapacity = 256;
+
+    struct DirtyRegion {
+        std::uint64_t version;
+        Box<real> bbox;
+    };
+
+    std::vector<Slot> slots_;
+    // evaluated in order, Noise last
+    std::tuple<
+        BasisStore<Grid>,
+        BasisStore<Radial>,
+        BasisStore<Heightmap>,
+        BasisStore<Noise>
+    > stores_;
+    std::uint64_t version_ = 0; // bumped on every edit, lets caches detect staleness
+
+    // rectangles touched by recent edits, oldest first. entries up to
+    // dirty_floor_ have been dropped.
+    std::deque<DirtyRegion> dirty_log_;
+    std::uint64_t dirty_floor_ = 0;
+
+    Box<real> influence(size_t idx) const;
+    void mark_dirty(const Box<real>& bbox);
+
+    BasisColumns& columns(BasisKind kind);
+    const BasisColumns& columns(BasisKind kind) const;
+
+    // after edits made through columns(), which bypass the stores
+    void refresh_far_field(BasisKind kind);
 
 public:
     TensorField();
 
     template <typename V>
     void add_basis(V&& basis) {
-        basis_fields.push_back(std::move(basis));
+        using B = std::remove_cvref_t<V>;
+        BasisStore<B>& store = std::get<BasisStore<B>>(stores_);
+
+        slots_.push_back({
+            BasisStore<B>::kind,
+            static_cast<std::uint32_t>(store.size())
+        });
+        store.push(basis);
+        ++version_;
+        mark_dirty(influence(slots_.size() - 1));
     }
 
-    const DVector2& get_centre(size_t idx) const;
-    const double& get_size(size_t idx) const;
-    const double& get_decay(size_t idx) const;
+    const RVector2& get_centre(size_t idx) const;
+    const real& get_size(size_t idx) const;
+    const real& get_decay(size_t idx) const;
 
 
-    void set_centre(size_t idx, DVector2 centre);
-    void set_size(size_t idx, double size);
-    void set_decay(size_t idx, double decay);
+    void set_centre(size_t idx, RVector2 centre);
+    void set_size(size_t idx, real size);
+    void set_decay(size_t idx, real decay);
 
     void erase(size_t idx);
 
     template<typename V>
     bool is(size_t idx) const {
-        if (idx >= basis_fields.size()) return false;
-
-        if (const V* ptr = std::get_if<V>(&basis_fields[idx])) {
-            return true;
-        }
+        if (idx >= slots_.size()) return false;
 
-        return false;
+        return slots_[idx].kind == BasisStore<V>::kind;
     }
 
+    // edits go through a materialised copy that is written back afterwards
     template<typename V, typename Func>
     void visit_if(size_t idx, Func&& func) {
-        if (idx >= basis_fields.size())
-            return;
+        if (!is<V>(idx)) return;
+
+        BasisStore<V>& store = std::get<BasisStore<V>>(stores_);
+        V field = store.load(slots_[idx].slot);
+        Box<real> before = influence(idx);
 
-        if (V* ptr = std::get_if<V>(&basis_fields[idx]))
-            std::invoke(std::forward<Func>(func), *ptr);
+        std::invoke(std::forward<Func>(func), field);
+
+        store.store(slots_[idx].slot, field);
+        ++version_;
+        mark_dirty(before);
+        mark_dirty(influence(idx));
     }
 
 
     template<typename V, typename Func>
     void visit_if(size_t idx, Func&& func) const {
-        if (idx >= basis_fields.size())
-            return;
+        if (!is<V>(idx)) return;
+
+        const BasisStore<V>& store = std::get<BasisStore<V>>(stores_);
+        const V field = store.load(slots_[idx].slot);
 
-        if (const V* ptr = std::get_if<V>(&basis_fields[idx]))
-            std::invoke(std::forward<Func>(func), *ptr);
+        std::invoke(std::forward<Func>(func), field);
     }
 
-    Tensor sample(const DVector2& pos) const;
+    Tensor sample(const RVector2& pos) const;
+
+    // structure-of-arrays sampling, all spans must have the same length.
+    // eigenvectors of degenerate samples are zero, as in Tensor.
+    void sample_batch(
+        std::span<const real> xs,
+        std::span<const real> ys,
+        std::span<real> a,
+        std::span<real> b,
+        std::span<RVector2> major,
+        std::span<RVector2> minor
+    ) const;
+
+    // zeros of (a, b) inside region, found by a sign-change search over a
+    // lattice of spacing cell anchored at region.min. (a, b) is treated as
+    // linear over the two triangles of each lattice cell.
+    std::vector<RVector2> degenerate_points(const Box<real>& region, real cell) const;
+
     size_t size() const;
+    std::uint64_t version() const;
     void clear();
+
+    // samples at pos what was sampled at origin + pos before. a tile far
+    // from the world origin is traced in small coordinates of its own on a
+    // copy moved to its corner. the noise is still sampled in world space,
+    // so moved copies share their noise tiles.
+    void move_origin(const RVector2& origin);
+
+    // world-space rectangles whose samples may differ from those at
+    // `version`. nullopt if the log no longer reaches back that far, in
+    // which case everything should be treated as dirty.
+    std::optional<std::vector<Box<real>>> dirty_since(std::uint64_t version) const;
+
+    // the whole plane, used for edits to unbounded (size 0) fields
+    static Box<real> everywhere();
 };
@@ -0,0 +1,75 @@
+#include "worker_pool.h"
+
+#include <algorithm>
+
+
+WorkerPool::WorkerPool(int threads) {
+    for (int i=1; i<threads; ++i) {
+        workers_.emplace_back(&WorkerPool::worker_loop, this, static_cast<size_t>(i));
+    }
+}
+
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    start_cv_.notify_all();
+
+    for (std::thread& w : workers_) w.join();
+}
+
+
+size_t WorkerPool::size() const {
+    return workers_.size() + 1;
+}
+
+
+void WorkerPool::run(size_t count, const Job& job) {
+    count = std::min(count, size());
+
+    if (count <= 1) {
+        if (count == 1) job(0);
+        return;
+    }
+
+    {
+        std::lock_guard lock(mutex_);
+        job_ = &job;
+        count_ = count;
+        pending_ = count - 1;
+        round_++;
+    }
+    start_cv_.notify_all();
+
+    job(0);
+
+    std::unique_lock lock(mutex_);
+    done_cv_.wait(lock, [this] { return pending_ == 0; });
+    job_ = nullptr;
+}
+
+
+// a round cannot end before every worker taking part has run it, so a
+// worker only ever skips rounds it has no part in
+void WorkerPool::worker_loop(size_t index) {
+    std::uint64_t seen = 0;
+    std::unique_lock lock(mutex_);
+
+    while (true) {
+        start_cv_.wait(lock, [&] { return stop_ || round_ != seen; });
+        if (stop_) return;
+
+        seen = round_;
+        if (index >= count_) continue;
+
+        const Job& job = *job_;
+
+        lock.unlock();
+        job(index);
+        lock.lock();
+
+        if (--pending_ == 0) done_cv_.notify_one();
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// threads kept alive between parallel sections, so a generator handing out
+// thousands of small batches does not start and join threads for each.
+// run() hands one job to the first count threads, the calling thread
+// counted as index 0, and returns once they have all finished it.
+class WorkerPool {
+private:
+    using Job = std::function<void(size_t index)>;
+
+    std::mutex mutex_; // guards job_, count_, pending_, round_, stop_
+    std::condition_variable start_cv_;
+    std::condition_variable done_cv_;
+    const Job* job_ = nullptr;
+    size_t count_ = 0;   // threads taking part in the current round
+    size_t pending_ = 0; // of them, workers still running it
+    std::uint64_t round_ = 0;
+    bool stop_ = false;
+
+    std::vector<std::thread> workers_;
+
+    void worker_loop(size_t index);
+
+public:
+    // threads in all, the caller of run() included
+    explicit WorkerPool(int threads);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    size_t size() const;
+
+    // job(i) for every i below min(count, size()), in parallel
+    void run(size_t count, const Job& job);
+};
+
+#endif
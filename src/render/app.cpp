@@ -1,6 +1,6 @@
 #include "app.h"
 #include "styles.h"
-#include <iostream>
+#include <filesystem>
 
 
 ToolBar::ToolBar(int window_height) :
@@ -52,9 +52,7 @@ void ToolBar::render_impl(Renderer* ren) {
 
 
 void App::run_generator() {
-    gen_.generate();
-    for (int i=0;i<gen_.road_type_count();++i)
-        std::cout << gen_.road_count(i, Eigenfield::major()) + gen_.road_count(i, Eigenfield::minor()) << std::endl;
+    world_.clear();
 }
 
 
@@ -72,15 +70,22 @@ void App::set_state(AppState s) {
 
 App::App(int w, int h, const char* window_title, GeneratorParameters* params, size_t road_type_count) :
     ren_(Renderer(w, h, window_title)),
+    field_pyramid_(&field_, 2.0, 8),
     params_(params),
-    gen_(RoadGenerator(&field_, road_type_count, params_, Box<double>{{0,0},{1,1}})),
+    gen_(RoadGenerator(&field_, road_type_count, params_, Box<real>{{0,0},{1,1}})),
+    world_(&field_, &gen_, kChunkSize,
+        (std::filesystem::temp_directory_path() / "citygen_chunks").string()),
     map_view(&gen_, default_styles),
     toolbar(ren_.height),
     field_view(&field_)
 {
+    field_view.set_pyramid(&field_pyramid_);
+    map_view.set_world(&world_);
+    gen_.set_trace_threads(0);
+
     set_state(Editor);
     reset_tensorfield();
-    gen_.reset(ren_.viewport);
+    gen_.reset(Box<real>(ren_.viewport));
 }
 
 
@@ -89,6 +94,10 @@ void App::main_loop() {
     ren_.begin_drawing(); {
         ClearBackground(RAYWHITE);
 
+        // chunks around the view are generated while the map is shown
+        if (app_state_ == Map)
+            world_.request(Box<real>(ren_.viewport));
+
         if (app_state_ == Editor) 
             field_view.render(&ren_);
 
@@ -40,10 +40,14 @@ public:
 
 class App  {
 private:
+    static constexpr real kChunkSize = 1024.0;
+
     Renderer ren_;
     TensorField field_;
+    FieldPyramid field_pyramid_;
     GeneratorParameters* params_;
     RoadGenerator gen_;
+    ChunkWorld world_;
 
     AppState app_state_;
 
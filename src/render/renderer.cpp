@@ -143,25 +143,80 @@ void TensorFieldView::set_style(FieldStyle s) {
 }
 
 
+void TensorFieldView::set_raster(FieldRaster* raster) {
+    raster_ = raster;
+}
+
+
+void TensorFieldView::set_pyramid(FieldPyramid* pyramid) {
+    pyramid_ = pyramid;
+}
+
+
 void TensorFieldView::render_impl(Renderer* ren) {
+    int level = 0;
+
+    if (pyramid_ != nullptr) {
+        level = pyramid_->level_for(style_.granularity/ren->camera.zoom);
+        pyramid_->request(Box<real>(ren->viewport), level);
+    } else if (raster_ != nullptr) {
+        raster_->update(Box<real>(ren->viewport));
+    }
+
+    xs_.clear();
+    ys_.clear();
+
     for (float i=0; i<ren->width; i+=style_.granularity) {
         for (float j=0; j<ren->height; j+=style_.granularity) {
-
             Vector2 world_pos = 
                 GetScreenToWorld2D(Vector2{i,j}, ren->camera);
 
-            Tensor t = tf_->sample(world_pos);
+            xs_.push_back(world_pos.x);
+            ys_.push_back(world_pos.y);
+        }
+    }
+
+    size_t n = xs_.size();
+    a_.resize(n);
+    b_.resize(n);
+    major_.resize(n);
+    minor_.resize(n);
+
+    if (pyramid_ != nullptr) {
+        // tiles still baking are filled in from the analytic field
+        for (size_t k=0; k<n; ++k) {
+            Tensor t;
+            if (!pyramid_->sample({xs_[k], ys_[k]}, level, t))
+                t = tf_->sample({xs_[k], ys_[k]});
+
+            major_[k] = t.get_major_eigenvector();
+            minor_[k] = t.get_minor_eigenvector();
+        }
+    } else if (raster_ != nullptr) {
+        for (size_t k=0; k<n; ++k) {
+            Tensor t = raster_->sample({xs_[k], ys_[k]});
+            major_[k] = t.get_major_eigenvector();
+            minor_[k] = t.get_minor_eigenvector();
+        }
+    } else {
+        tf_->sample_batch(xs_, ys_, a_, b_, major_, minor_);
+    }
+
+    size_t k = 0;
+    for (float i=0; i<ren->width; i+=style_.granularity) {
+        for (float j=0; j<ren->height; j+=style_.granularity, ++k) {
+            Vector2 world_pos = RVector2{xs_[k], ys_[k]};
 
             draw_eigen_line(
                 ren,
-                t.get_major_eigenvector(),
+                major_[k],
                 world_pos,
                 style_.major_col
             );
 
             draw_eigen_line(
                 ren,
-                t.get_minor_eigenvector(),
+                minor_[k],
                 world_pos,
                 style_.minor_col
             );
@@ -208,12 +263,88 @@ void MapView::draw_road_2d(const RoadHandle& handle,
 }
 
 
+void MapView::draw_chunk_road_2d(const RVector2& origin,
+    const ChunkWorld::ChunkRoad& road, const RoadStyle& style)
+{
+    points_.clear();
+    for (const Vector2& p : road.points) {
+        points_.push_back(Vector2(origin + RVector2(p)));
+    }
+
+    DrawSplineLinear(
+        points_.data(),
+        points_.size(),
+        style.outline_width+style.width,
+        style.outline_col
+    );
+
+    DrawSplineLinear(
+        points_.data(),
+        points_.size(),
+        style.width,
+        style.col
+    );
+}
+
+
+void MapView::draw_world_2d() {
+    const auto& views = world_->visible();
+
+    for (int road_type = gen_->road_type_count()-1; road_type>=0; --road_type) {
+        const RoadStyle& style = styles_[road_type];
+        size_t type = static_cast<size_t>(road_type);
+
+        for (const ChunkWorld::View& view : views) {
+            for (const ChunkWorld::ChunkRoad& road : view.data->roads) {
+                if (road.road_type == type)
+                    draw_chunk_road_2d(view.origin, road, style);
+            }
+
+            for (const auto& seam : view.seams) {
+                if (seam == nullptr) continue;
+
+                for (const ChunkWorld::ChunkRoad& road : *seam) {
+                    if (road.road_type == type)
+                        draw_chunk_road_2d(view.origin, road, style);
+                }
+            }
+        }
+    }
+}
+
+
+void MapView::draw_obstacles_2d() const {
+    const ObstacleMask& obstacles = gen_->get_obstacles();
+
+    for (size_t i=0; i<obstacles.size(); ++i) {
+        const std::vector<RVector2>& poly = obstacles.get_polygon(i);
+
+        for (size_t j=0, k=poly.size()-1; j<poly.size(); k=j++) {
+            DrawLineEx(poly[k], poly[j], 2.0f, obstacle_col);
+        }
+    }
+}
+
+
 MapView::MapView(RoadGenerator* gen, const RoadStyle* styles) :
     gen_(gen), styles_(styles) {}
 
+
+void MapView::set_world(const ChunkWorld* world) {
+    world_ = world;
+}
+
+
 void MapView::render_2d_impl(Renderer* ren) {
     if (styles_ == nullptr) return;
 
+    draw_obstacles_2d();
+
+    if (world_ != nullptr) {
+        draw_world_2d();
+        return;
+    }
+
     const auto& num_road_type = gen_->road_type_count();
     
     Eigenfield efs[2] = {Eigenfield::major(), Eigenfield::minor()};
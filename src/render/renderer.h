@@ -2,6 +2,8 @@
 #define RENDERER_H
 
 #include "styles.h"
+#include "../generation/chunk_world.h"
+#include "../generation/field_pyramid.h"
 #include "../generation/generator.h"
 
 
@@ -59,13 +61,21 @@ public:
 class TensorFieldView : public Component {
 private:
     TensorField* tf_;
+    FieldRaster* raster_ = nullptr;
+    FieldPyramid* pyramid_ = nullptr;
     FieldStyle style_;
 
+    // reused per frame glyph sample buffers (structure of arrays)
+    std::vector<real> xs_, ys_, a_, b_;
+    std::vector<RVector2> major_, minor_;
+
     void draw_eigen_line(Renderer* ren, const Vector2& vec, 
         const Vector2& world_pos, Color col) const;
 public:
     TensorFieldView(TensorField* tf_ptr);
     void set_style(FieldStyle s);
+    void set_raster(FieldRaster* raster);
+    void set_pyramid(FieldPyramid* pyramid);
     void render_impl(Renderer* ren) override;
 };
 
@@ -76,13 +86,23 @@ public:
 class MapView : public Component {
 private:
     RoadGenerator* gen_;
+    const ChunkWorld* world_ = nullptr;
     const RoadStyle* styles_;
 
+    std::vector<Vector2> points_; // chunk roads moved to world space
+
     void draw_road_2d(const RoadHandle& handle,
             const RoadStyle& style) const;
+    void draw_chunk_road_2d(const RVector2& origin,
+            const ChunkWorld::ChunkRoad& road, const RoadStyle& style);
+    void draw_world_2d();
+    void draw_obstacles_2d() const;
 public:
     MapView(RoadGenerator* gen, const RoadStyle* styles);
 
+    // draws the visible chunks of world instead of the generator's roads
+    void set_world(const ChunkWorld* world);
+
     void render_2d_impl(Renderer* ren) override;
 };
 
@@ -43,6 +43,8 @@ static constexpr RoadStyle side_street_style {
 
 static constexpr RoadStyle default_styles[3] = {main_road_style, high_street_style, side_street_style};
 
+static constexpr Color obstacle_col {170, 211, 223, 255};
+
 struct ToolBarStyle {
     Color col = LIGHTGRAY;
     float width = 60;
@@ -1,7 +1,9 @@
 #ifndef TYPES_H 
 #define TYPES_H 
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <ostream>
 
 #include "raylib.h"
@@ -14,8 +16,14 @@ struct TVector2 {
     TVector2() : x(0.0), y(0.0){}
     TVector2(T _x, T _y) : x(_x), y(_y) {}
     TVector2(const Vector2 v) : 
-        x(static_cast<double>(v.x)), 
-        y(static_cast<double>(v.y)) 
+        x(static_cast<T>(v.x)), 
+        y(static_cast<T>(v.y)) 
+    {}
+
+    template<typename U>
+    explicit TVector2(const TVector2<U>& v) :
+        x(static_cast<T>(v.x)),
+        y(static_cast<T>(v.y))
     {}
 
     operator Vector2() const {
@@ -25,7 +33,7 @@ struct TVector2 {
         };
     }
 
-    double mag() const {
+    T mag() const {
         return std::hypot(x, y);
     }
 
@@ -50,16 +58,16 @@ struct TVector2 {
     template<typename U>
     TVector2 operator*(const U& scalar) const {
         return {
-            scalar*x,
-            scalar*y
+            static_cast<T>(scalar*x),
+            static_cast<T>(scalar*y)
         };
     };
 
     template<typename U>
     TVector2 operator/(const U& scalar) const {
         return {
-            x/scalar,
-            y/scalar
+            static_cast<T>(x/scalar),
+            static_cast<T>(y/scalar)
         };
     }
 
@@ -78,6 +86,13 @@ T dot_product(const TVector2<T>& a, const TVector2<T>& b) {
 }
 
 
+// positive when b is counterclockwise of a
+template<typename T>
+T cross_product(const TVector2<T>& a, const TVector2<T>& b) {
+    return a.x*b.y - a.y*b.x;
+}
+
+
 template<typename T>
 TVector2<T> middle(TVector2<T> const& p1, TVector2<T> const& p2) {
     return (p1 + p2)/2.0;
@@ -85,23 +100,23 @@ TVector2<T> middle(TVector2<T> const& p1, TVector2<T> const& p2) {
 
 
 template<typename T>
-double vector_angle(const TVector2<T>& a, const TVector2<T>& b) {
-    double dot = dot_product(a, b);
-    double det = a.x*b.y - a.y*b.x;
+T vector_angle(const TVector2<T>& a, const TVector2<T>& b) {
+    T dot = dot_product(a, b);
+    T det = a.x*b.y - a.y*b.x;
 
     return atan2(det, dot);
 }
 
 
 template<typename T>
-double perpendicular_distance(const TVector2<T>& p, const TVector2<T>& x0, const TVector2<T>& x1) {
+T perpendicular_distance(const TVector2<T>& p, const TVector2<T>& x0, const TVector2<T>& x1) {
     TVector2<T> d = x1 - x0;
 
-    double l2 = dot_product(d, d); // 0 line length
+    T l2 = dot_product(d, d); // 0 line length
     if (l2 == 0.0) {
         TVector2<T> res = x1 - p;
-        double dx = res.x;
-        double dy = res.y;
+        T dx = res.x;
+        T dy = res.y;
         return std::hypot(dx, dy);
     }
 
@@ -110,6 +125,52 @@ double perpendicular_distance(const TVector2<T>& p, const TVector2<T>& x0, const
 }
 
 
+// distance from p to the segment x0 x1 (not the infinite line)
+template<typename T>
+T segment_distance(const TVector2<T>& p, const TVector2<T>& x0, const TVector2<T>& x1) {
+    TVector2<T> d = x1 - x0;
+    TVector2<T> r = p - x0;
+
+    T l2 = dot_product(d, d);
+    T t = l2 == 0 ? 0 : std::clamp(dot_product(r, d)/l2, T(0), T(1));
+
+    TVector2<T> closest = r - d*t;
+    return std::hypot(closest.x, closest.y);
+}
+
+
+// distance between the segments p0 p1 and q0 q1, 0 where they cross
+template<typename T>
+T segments_distance(const TVector2<T>& p0, const TVector2<T>& p1,
+    const TVector2<T>& q0, const TVector2<T>& q1)
+{
+    auto cross = [](const TVector2<T>& a, const TVector2<T>& b) {
+        return a.x*b.y - a.y*b.x;
+    };
+
+    T d0 = cross(p1 - p0, q0 - p0);
+    T d1 = cross(p1 - p0, q1 - p0);
+    T d2 = cross(q1 - q0, p0 - q0);
+    T d3 = cross(q1 - q0, p1 - q0);
+
+    T d = std::min({
+        segment_distance(p0, q0, q1),
+        segment_distance(p1, q0, q1),
+        segment_distance(q0, p0, p1),
+        segment_distance(q1, p0, p1)
+    });
+
+    // the signs of nearly collinear segments are rounding noise, so the
+    // crossing is measured rather than trusted
+    if ((d0 > 0) != (d1 > 0) && (d2 > 0) != (d3 > 0)) {
+        TVector2<T> x = q0 + (q1 - q0)*(d0/(d0 - d1));
+        d = std::min(d, segment_distance(x, p0, p1));
+    }
+
+    return d;
+}
+
+
 enum Quadrant {
     TopLeft,
     TopRight,
@@ -134,6 +195,12 @@ struct Box {
         max(_max)
     {}
 
+    template<typename U>
+    explicit Box(const Box<U>& other) :
+        min(other.min),
+        max(other.max)
+    {}
+
     bool is_empty() const {
         return min.x >= max.x
             && min.y >= max.y;
@@ -324,8 +391,16 @@ public:
 };
 
 
+// generation scalar, build with -DSINGLE_PRECISION for a float pipeline
+#ifdef SINGLE_PRECISION
+using real = float;
+#else
+using real = double;
+#endif
+
 // useful type aliases
 using DVector2 = TVector2<double>;
 using IVector2 = TVector2<int>;
+using RVector2 = TVector2<real>;
 
 #endif
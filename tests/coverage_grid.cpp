@@ -0,0 +1,56 @@
+#include <cstdio>
+
+#include "../src/generation/coverage_grid.h"
+
+
+// a cell whose corners are covered by different points stays open, one
+// point covering it all closes it, and a rejected draw splits its part
+// so the draws only come from the quarters left open
+static int failures = 0;
+
+
+static void check(bool ok, const char* what) {
+    if (ok) return;
+
+    std::printf("coverage_grid: %s\n", what);
+    failures++;
+}
+
+
+int main() {
+    CoverageGrid grid;
+    grid.reset(Box<real>({0, 0}, {4, 4}), 4);
+
+    // each covers one corner, the middle is 2.8 from all four
+    const RVector2 corners[4] = {{-1, -1}, {5, -1}, {-1, 5}, {5, 5}};
+    for (const RVector2& p : corners) grid.cover(p, 1.5);
+
+    check(grid.open_count() == 1, "closed by corners covered by four points");
+
+    grid.cover({2, 2}, 3);
+    check(grid.saturated() && grid.covered({1, 1}), "open inside a single point's radius");
+
+    grid.reset(Box<real>({0, 0}, {4, 4}), 4);
+    CounterRng rng(CounterRng::key({7}));
+
+    // the right half holds no free seed
+    grid.draw(rng);
+    grid.reject([](const Box<real>& box) { return box.min.x >= 2; });
+    check(grid.open_count() == 2, "right quarters not closed, left not open");
+
+    int draws = 0;
+    while (!grid.saturated() && draws < 1000) {
+        RVector2 pos = grid.draw(rng);
+        draws++;
+
+        check(pos.x < 2, "drawn from a closed quarter");
+        grid.reject([](const Box<real>&) { return false; });
+    }
+
+    check(grid.saturated(), "not saturated after rejecting every draw");
+
+    std::printf("coverage_grid: saturated after %d rejected draws, %d failed\n",
+        draws, failures);
+
+    return failures == 0 ? 0 : 1;
+}
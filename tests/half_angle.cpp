@@ -0,0 +1,75 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "../src/generation/tensor_field.h"
+
+
+// Tensor::half_angle against the trig it replaced, cos/sin(atan2(b, a)/2).
+// eigenvectors have no sign, so either sign of the reference counts.
+static constexpr real kTolerance = 16*d_epsilon;
+static constexpr int kRandomTensors = 2000000;
+
+
+// uniform in [0, 1), the same on every standard library
+static double unit(std::mt19937_64& rng) {
+    return (rng() >> 11)*0x1p-53;
+}
+
+
+static RVector2 reference(real a, real b) {
+    real theta = std::atan2(b, a)/2;
+    return {std::cos(theta), std::sin(theta)};
+}
+
+
+static real error(real a, real b) {
+    RVector2 e = Tensor::from_a_b(a, b).get_major_eigenvector();
+    RVector2 ref = reference(a, b);
+
+    RVector2 plus = e - ref;
+    RVector2 minus = e + ref;
+
+    return std::sqrt(std::min(dot_product(plus, plus), dot_product(minus, minus)));
+}
+
+
+int main() {
+    std::vector<RVector2> cases = {
+        {1, 0}, {-1, 0}, {0, 1}, {0, -1},
+        {-1, real(0.0)}, {-1, real(-0.0)}, {real(-0.0), 1}, {real(-0.0), -1},
+        {1, d_epsilon}, {1, -d_epsilon}, {-1, d_epsilon}, {-1, -d_epsilon},
+        {d_epsilon, 1}, {-d_epsilon, 1}, {d_epsilon, -1}, {-d_epsilon, -1},
+        {1, 1}, {-1, 1}, {1, -1}, {-1, -1}
+    };
+
+    std::mt19937_64 rng(5);
+
+    for (int i=0; i<kRandomTensors; ++i) {
+        // magnitudes over six decades
+        real r = static_cast<real>(std::pow(10.0, unit(rng)*6 - 3));
+        real angle = static_cast<real>((unit(rng)*2 - 1)*M_PI);
+
+        cases.push_back({r*std::cos(angle), r*std::sin(angle)});
+    }
+
+    int failures = 0;
+    real worst = 0;
+
+    for (const RVector2& c : cases) {
+        real e = error(c.x, c.y);
+        worst = std::max(worst, e);
+
+        if (!(e <= kTolerance)) {
+            if (failures++ < 10)
+                std::printf("half_angle(%g, %g) is %g off\n", (double)c.x, (double)c.y, (double)e);
+        }
+    }
+
+    std::printf("half_angle: %zu tensors, max error %.3g, tolerance %.3g, %d failed\n",
+        cases.size(), (double)worst, (double)kTolerance, failures);
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,49 @@
+#include <cstdio>
+#include <vector>
+
+#include "../src/generation/noise_tiles.h"
+
+
+// panning across far more tiles than NoiseTiles keeps: the cache stays
+// bounded and a tile evicted and baked again samples the same
+static constexpr int kSweep = 128; // tiles per side, 16384 in all
+static constexpr size_t kMaxTiles = 4096;
+
+
+int main() {
+    NoiseTiles tiles;
+
+    std::vector<real> first;
+    for (int i=0; i<8; ++i) first.push_back(tiles.sample(3, i + real(0.3), real(0.6)));
+
+    size_t most = 0;
+
+    for (int ty=0; ty<kSweep; ++ty) {
+        for (int tx=0; tx<kSweep; ++tx) {
+            tiles.sample(3, tx + real(0.5), 100 + ty + real(0.5));
+            most = std::max(most, tiles.tile_count());
+        }
+    }
+
+    int failures = 0;
+
+    if (most > kMaxTiles) {
+        std::printf("noise_tiles: %zu tiles held, cap %zu\n", most, kMaxTiles);
+        failures++;
+    }
+
+    for (int i=0; i<8; ++i) {
+        real again = tiles.sample(3, i + real(0.3), real(0.6));
+
+        if (again != first[i]) {
+            std::printf("noise_tiles: tile %d sampled %g, then %g\n",
+                i, (double)first[i], (double)again);
+            failures++;
+        }
+    }
+
+    std::printf("noise_tiles: %d tiles swept, at most %zu held, %d failed\n",
+        kSweep*kSweep, most, failures);
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,116 @@
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#include "../src/generation/generator.h"
+
+
+// speculative batches against the serial loop, with main.cpp's parameters
+// on a 1920x1080 viewport. the roads differ from the serial loop's, the
+// seeds are drawn in another order, but every road committed is the one
+// the serial loop would trace from its seed, and the roads are the same
+// for any number of threads
+static constexpr size_t kRoadTypes = 3;
+
+
+struct Roads {
+    std::vector<std::vector<Vector2>> points;
+    RoadGenerator::TraceCounts counts;
+};
+
+
+static Roads generate(int threads, int lockstep) {
+    GeneratorParameters params[kRoadTypes] = {
+        GeneratorParameters(1900, 400.0, 200.0, 10.0, 1.0, 500.0, 0.1, 0.5, 10.0),
+        GeneratorParameters(3020, 100.0,  30.0, 8.0, 1.0, 200.0, 0.1, 0.5, 10.0),
+        GeneratorParameters(1970,  20.0,  15.0, 5.0, 1.0,  40.0, 0.1, 0.5, 10.0)
+    };
+
+    TensorField field;
+    field.add_basis(Grid(0.3, {0, 0}, 0, 0));
+    field.add_basis(Radial({900, 500}, 400, 1));
+    field.add_basis(Grid(1.0, {300, 800}, 300, 2));
+
+    RoadGenerator gen(&field, kRoadTypes, params, Box<real>({0, 0}, {1920, 1080}));
+    gen.set_trace_threads(threads);
+    gen.set_lockstep_seeds(lockstep);
+    gen.set_count_trace(true);
+    gen.set_verify_speculation(true);
+    gen.generate();
+
+    Roads out;
+    out.counts = gen.trace_counts();
+
+    for (size_t road_type=0; road_type<kRoadTypes; ++road_type) {
+        for (Eigenfield ef : {Eigenfield::major(), Eigenfield::minor()}) {
+            for (std::uint32_t idx=0; idx<gen.road_count(road_type, ef); ++idx) {
+                auto [n, points] = gen.get_road_points(RoadHandle{idx, road_type, ef});
+                out.points.emplace_back(points, points + n);
+            }
+        }
+    }
+
+    return out;
+}
+
+
+static bool same(const Roads& a, const Roads& b) {
+    if (a.points.size() != b.points.size()) return false;
+
+    for (size_t i=0; i<a.points.size(); ++i) {
+        const auto& pa = a.points[i];
+        const auto& pb = b.points[i];
+        if (pa.size() != pb.size()) return false;
+
+        for (size_t j=0; j<pa.size(); ++j) {
+            if (pa[j].x != pb[j].x || pa[j].y != pb[j].y) return false;
+        }
+    }
+
+    return true;
+}
+
+
+int main() {
+    // the generator logs its seeds to cout
+    std::cout.setstate(std::ios::failbit);
+
+    struct Run {
+        int threads;
+        int lockstep;
+    };
+
+    const Run runs[] = {{2, 0}, {3, 0}, {8, 0}, {1, 16}, {4, 16}};
+
+    Roads serial = generate(1, 0);
+    std::vector<Roads> speculative;
+
+    int failures = 0;
+
+    for (const Run& run : runs) {
+        speculative.push_back(generate(run.threads, run.lockstep));
+        const Roads& roads = speculative.back();
+
+        if (roads.counts.mispredicted > 0) {
+            std::printf("speculative: %d threads, lockstep %d: %llu of %llu roads "
+                "differ from a serial trace of their seed\n",
+                run.threads, run.lockstep,
+                (unsigned long long)roads.counts.mispredicted,
+                (unsigned long long)roads.counts.committed);
+            failures++;
+        }
+
+        // against the first run of the same kind
+        const Roads& first = speculative[run.lockstep > 0 ? 3 : 0];
+        if (!same(roads, first)) {
+            std::printf("speculative: %d threads, lockstep %d: roads differ from %d threads\n",
+                run.threads, run.lockstep, runs[run.lockstep > 0 ? 3 : 0].threads);
+            failures++;
+        }
+    }
+
+    std::printf("speculative: %zu runs, %zu roads against %zu serial, %d failed\n",
+        std::size(runs), speculative[0].points.size(), serial.points.size(), failures);
+
+    return failures == 0 ? 0 : 1;
+}
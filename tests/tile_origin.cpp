@@ -0,0 +1,73 @@
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include "../src/generation/generator.h"
+
+
+// a tile traced relative to its corner comes out the same however far
+// from the world origin it is: the world moved by 2^20, where a float
+// only resolves an eighth of a unit, gives the roads of the unmoved one
+static constexpr size_t kRoadTypes = 3;
+static constexpr real kOffset = 1048576;
+
+
+static void build(TensorField& field, RVector2 offset) {
+    field.add_basis(Grid(0.3, RVector2{0, 0} + offset, 0, 0));
+    field.add_basis(Radial(RVector2{300, 200} + offset, 400, 1));
+    field.add_basis(Grid(1.0, RVector2{100, 400} + offset, 300, 2));
+}
+
+
+int main() {
+    // the generator logs its seeds to cout
+    std::cout.setstate(std::ios::failbit);
+
+    constexpr real inf = std::numeric_limits<real>::infinity();
+
+    GeneratorParameters params[kRoadTypes] = {
+        GeneratorParameters(1900, 400.0, 200.0, 10.0, 1.0, 500.0, 0.1, 0.5, 10.0),
+        GeneratorParameters(3020, 100.0,  30.0, 8.0, 1.0, 200.0, 0.1, 0.5, 10.0),
+        GeneratorParameters(1970,  20.0,  15.0, 5.0, 1.0,  40.0, 0.1, 0.5, 10.0)
+    };
+
+    RVector2 offset = {kOffset, kOffset};
+    Box<real> core({0, 0}, {512, 512});
+    Box<real> limit({-inf, -inf}, {inf, inf});
+
+    TensorField near, far;
+    build(near, {0, 0});
+    build(far, offset);
+
+    RoadGenerator proto(&near, kRoadTypes, params, Box<real>({0, 0}, {1, 1}));
+
+    std::vector<RoadGenerator::TilePiece> a = proto.generate_tile(
+        &near, core, limit, 7, core.min);
+    std::vector<RoadGenerator::TilePiece> b = proto.generate_tile(
+        &far, Box<real>(core.min + offset, core.max + offset), limit, 7, core.min + offset);
+
+    int failures = 0;
+    size_t points = 0;
+
+    if (a.size() != b.size()) {
+        std::printf("tile_origin: %zu pieces at the origin, %zu moved\n", a.size(), b.size());
+        failures++;
+    }
+
+    for (size_t i=0; i<std::min(a.size(), b.size()); ++i) {
+        points += a[i].points.size();
+
+        bool same = a[i].road_type == b[i].road_type && a[i].ef == b[i].ef
+            && a[i].open == b[i].open && a[i].points == b[i].points;
+
+        if (!same) {
+            std::printf("tile_origin: piece %zu differs once moved\n", i);
+            failures++;
+        }
+    }
+
+    std::printf("tile_origin: %zu pieces, %zu points, %d failed\n", a.size(), points, failures);
+
+    return failures == 0 ? 0 : 1;
+}
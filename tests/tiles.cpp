@@ -0,0 +1,169 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#include "../src/generation/generator.h"
+
+
+// tiled generation with main.cpp's parameters on a 1920x1080 viewport. the
+// roads are the same for any number of threads, and once stitched no two
+// roads of a type and eigenfield come closer than d_test/2 between their
+// ends, at the seams or elsewhere. joins are off, they end on other roads.
+static constexpr size_t kRoadTypes = 3;
+
+static const GeneratorParameters kParams[kRoadTypes] = {
+    GeneratorParameters(1900, 400.0, 200.0, 10.0, 1.0, 500.0, 0.1, 0.5, 10.0),
+    GeneratorParameters(3020, 100.0,  30.0, 8.0, 1.0, 200.0, 0.1, 0.5, 10.0),
+    GeneratorParameters(1970,  20.0,  15.0, 5.0, 1.0,  40.0, 0.1, 0.5, 10.0)
+};
+
+
+struct TiledRoad {
+    size_t road_type;
+    Eigenfield ef;
+    std::vector<Vector2> points;
+};
+
+
+static std::vector<TiledRoad> generate(int tiles, int threads) {
+    TensorField field;
+    field.add_basis(Grid(0.3, {0, 0}, 0, 0));
+    field.add_basis(Radial({900, 500}, 400, 1));
+    field.add_basis(Grid(1.0, {300, 800}, 300, 2));
+
+    GeneratorParameters params[kRoadTypes] = {kParams[0], kParams[1], kParams[2]};
+
+    RoadGenerator gen(&field, kRoadTypes, params, Box<real>({0, 0}, {1920, 1080}));
+    gen.set_tiles(tiles, tiles);
+    gen.set_trace_threads(threads);
+    gen.set_join_roads(false);
+    gen.generate();
+
+    std::vector<TiledRoad> out;
+
+    for (size_t road_type=0; road_type<kRoadTypes; ++road_type) {
+        for (Eigenfield ef : {Eigenfield::major(), Eigenfield::minor()}) {
+            for (std::uint32_t idx=0; idx<gen.road_count(road_type, ef); ++idx) {
+                auto [n, points] = gen.get_road_points(RoadHandle{idx, road_type, ef});
+                out.push_back({road_type, ef, {points, points + n}});
+            }
+        }
+    }
+
+    return out;
+}
+
+
+static bool same(const std::vector<TiledRoad>& a, const std::vector<TiledRoad>& b) {
+    if (a.size() != b.size()) return false;
+
+    for (size_t i=0; i<a.size(); ++i) {
+        const auto& pa = a[i].points;
+        const auto& pb = b[i].points;
+        if (pa.size() != pb.size()) return false;
+
+        for (size_t j=0; j<pa.size(); ++j) {
+            if (pa[j].x != pb[j].x || pa[j].y != pb[j].y) return false;
+        }
+    }
+
+    return true;
+}
+
+
+// interior points within d_test/2 of a point of another road, found through
+// a grid of d_test/2 cells per road type and eigenfield
+static size_t close_points(const std::vector<TiledRoad>& roads) {
+    struct Entry {
+        size_t road;
+        Vector2 pos;
+    };
+
+    auto key = [](const TiledRoad& road, std::int64_t cx, std::int64_t cy) {
+        return (static_cast<std::uint64_t>(road.road_type*2 + static_cast<size_t>(road.ef)) << 56)
+            ^ (static_cast<std::uint64_t>(cx & 0xfffffff) << 28)
+            ^ static_cast<std::uint64_t>(cy & 0xfffffff);
+    };
+
+    auto cell = [](const TiledRoad& road, float v) {
+        return static_cast<std::int64_t>(std::floor(v/(kParams[road.road_type].d_test/2)));
+    };
+
+    std::unordered_map<std::uint64_t, std::vector<Entry>> grid;
+
+    for (size_t i=0; i<roads.size(); ++i) {
+        for (const Vector2& p : roads[i].points) {
+            grid[key(roads[i], cell(roads[i], p.x), cell(roads[i], p.y))].push_back({i, p});
+        }
+    }
+
+    size_t close = 0;
+
+    for (size_t i=0; i<roads.size(); ++i) {
+        const TiledRoad& road = roads[i];
+        float d = kParams[road.road_type].d_test/2;
+
+        for (size_t k=1; k+1<road.points.size(); ++k) {
+            const Vector2& p = road.points[k];
+            std::int64_t cx = cell(road, p.x);
+            std::int64_t cy = cell(road, p.y);
+            bool found = false;
+
+            for (std::int64_t y=cy-1; y<=cy+1 && !found; ++y) {
+                for (std::int64_t x=cx-1; x<=cx+1 && !found; ++x) {
+                    auto it = grid.find(key(road, x, y));
+                    if (it == grid.end()) continue;
+
+                    for (const Entry& e : it->second) {
+                        float dx = e.pos.x - p.x;
+                        float dy = e.pos.y - p.y;
+                        if (e.road != i && dx*dx + dy*dy < d*d) {
+                            found = true;
+                            break;
+                        }
+                    }
+                }
+            }
+
+            if (found) close++;
+        }
+    }
+
+    return close;
+}
+
+
+int main() {
+    // the generator logs its seeds to cout
+    std::cout.setstate(std::ios::failbit);
+
+    const int grids[] = {2, 3, 4};
+
+    int failures = 0;
+    size_t roads = 0;
+
+    for (int tiles : grids) {
+        std::vector<TiledRoad> single = generate(tiles, 1);
+        std::vector<TiledRoad> threaded = generate(tiles, 4);
+        roads += single.size();
+
+        if (!same(single, threaded)) {
+            std::printf("tiles: %dx%d tiles on 4 threads differ from 1 thread\n", tiles, tiles);
+            failures++;
+        }
+
+        size_t close = close_points(single);
+        if (close > 0) {
+            std::printf("tiles: %dx%d tiles leave %zu points within d_test/2 of another road\n",
+                tiles, tiles, close);
+            failures++;
+        }
+    }
+
+    std::printf("tiles: %zu grids, %zu roads, %d failed\n", std::size(grids), roads, failures);
+
+    return failures == 0 ? 0 : 1;
+}